@@ -0,0 +1,310 @@
+// File outputter which writes compressed, independently decodable blocks.
+// Producers only append to an in-memory block; full blocks are handed to a
+// dedicated flush thread which compresses and writes them.
+
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Outputter.hpp"
+#include "details/BlockCodec.hpp"
+
+namespace lfy {
+
+using details::BlockCodec;
+
+// What producers do when the flush thread falls MaxPendingBlocks behind.
+enum class Overflow {
+  Block, // Wait for the flush thread: logging slows down to the disk's speed
+  Drop   // Drop the record and count it, see Outputter::getMetrics
+};
+
+// N is the uncompressed block size. A crash loses up to MaxPendingBlocks + 2
+// blocks, i.e. 10: the block being filled, the ones queued for compression
+// and the one the flush thread compresses and writes.
+template <std::size_t N> class CompressedFileOutputter : public Outputter {
+public:
+  // Upper bound of blocks waiting for the flush thread. If the compressor
+  // falls behind by this many blocks, producers wait for it by default, so
+  // no record is lost while the process keeps running. With Overflow::Drop,
+  // they drop the records which do not fit instead. Flushes, syncs and
+  // reopens always wait.
+  static constexpr std::size_t MaxPendingBlocks = 8;
+
+  CompressedFileOutputter(std::filesystem::path filePath,
+                          BlockCodec codec = details::default_codec(),
+                          WriteBehind writeBehind = {},
+                          Overflow overflow = Overflow::Block)
+      : m_filePath{std::move(filePath)}, m_codec{codec},
+        m_overflow{overflow} {
+    m_file = openFile();
+    if (writeBehind.syncBytes != 0 || writeBehind.dropBytes != 0)
+      m_writeBehind = details::WriteBehindTracker{
+          writeBehind, details::file_size(m_file)};
+    m_block.reserve(N);
+    // Buffers for every other block which can be in flight, so producers do
+    // not allocate. Pages are committed once a block is actually filled.
+    m_spare.resize(MaxPendingBlocks + 1);
+    for (std::vector<char> &spare : m_spare)
+      spare.reserve(N);
+    m_flushThread = std::thread([this] { flushLoop(); });
+  }
+
+  ~CompressedFileOutputter() override {
+    {
+      std::unique_lock l{m_mutex};
+      handOffUnlocked(l);
+      m_stop = true;
+    }
+    m_pendingCv.notify_one();
+    m_flushThread.join();
+    details::close_native(m_file);
+  }
+
+  void output(const std::string &message) override {
+    std::unique_lock l{m_mutex};
+    rethrowUnlocked();
+
+    const bool wait = m_overflow == Overflow::Block;
+    if (m_block.size() + message.size() + 1 > N && !handOffUnlocked(l, wait)) {
+      countDrop();
+      return;
+    }
+
+    // Oversized messages become a block of their own.
+    if (message.size() + 1 > N) {
+      if (!wait && m_pendingCount >= MaxPendingBlocks) {
+        countDrop();
+        return;
+      }
+      m_block.reserve(message.size() + 1);
+      m_block.insert(m_block.end(), message.begin(), message.end());
+      m_block.push_back('\n');
+      handOffUnlocked(l);
+      return;
+    }
+
+    m_block.insert(m_block.end(), message.begin(), message.end());
+    m_block.push_back('\n');
+  }
+
+  std::chrono::steady_clock::time_point lastFlush() override {
+    std::lock_guard l{m_mutex};
+    return m_lastFlush;
+  }
+
+  // Queues the current block for compression; does not wait for the write.
+  void flush() override {
+    std::unique_lock l{m_mutex};
+    rethrowUnlocked();
+    handOffUnlocked(l);
+  }
+
+  // Waits until every queued block is written, then syncs the file.
+  void sync() override {
+    {
+      std::unique_lock l{m_mutex};
+      rethrowUnlocked();
+      handOffUnlocked(l);
+      const std::uint64_t target = m_blocksHandedOff;
+      m_spaceCv.wait(l, [&] { return m_blocksWritten >= target || m_error; });
+      rethrowUnlocked();
+    }
+    m_groupCommit.commit([this] {
+      std::shared_lock f{m_fileMutex};
+      details::sync_data(m_file);
+    });
+  }
+
+  [[nodiscard]] std::string getName() const override {
+    return m_filePath.string();
+  }
+
+  // Frames are self-contained, so the new file starts with the next block.
+  void reopen() override {
+    std::unique_lock l{m_mutex};
+    rethrowUnlocked();
+    handOffUnlocked(l);
+    const std::uint64_t target = m_blocksHandedOff;
+    m_spaceCv.wait(l, [&] { return m_blocksWritten >= target || m_error; });
+    rethrowUnlocked();
+    // The flush thread only touches the file for blocks taken off the queue
+    // under the lock, so it is idle now.
+    details::NativeFile file = openFile();
+    std::lock_guard f{m_fileMutex};
+    details::close_native(m_file);
+    m_file = file;
+    m_writeBehind.restart(details::file_size(m_file));
+  }
+
+private:
+  details::NativeFile openFile() const {
+    details::NativeFile file = details::open_for_append(m_filePath);
+    if (!details::valid(file)) {
+      throw std::runtime_error(
+          "CompressedFileOutputter: Failed to open file " +
+          m_filePath.string() +
+          (std::filesystem::exists(m_filePath) ? " (Not enough access rights)"
+                                               : ""));
+    }
+    return file;
+  }
+
+  // Moves the current block to the pending queue, waiting while the queue is
+  // saturated (see MaxPendingBlocks) unless wait is false; then the block is
+  // kept and false returned. The flush thread keeps draining the queue after
+  // errors, too.
+  bool handOffUnlocked(std::unique_lock<std::mutex> &lock, bool wait = true) {
+    if (!m_block.empty() && m_pendingCount >= MaxPendingBlocks) {
+      if (!wait)
+        return false;
+      m_spaceCv.wait(lock,
+                     [this] { return m_pendingCount < MaxPendingBlocks; });
+    }
+    // Another producer may have handed the block off while we waited.
+    if (m_block.empty())
+      return true;
+
+    m_pending[(m_pendingHead + m_pendingCount++) % MaxPendingBlocks] =
+        std::move(m_block);
+    ++m_blocksHandedOff;
+    if (!m_spare.empty()) {
+      m_block = std::move(m_spare.back());
+      m_spare.pop_back();
+    } else {
+      m_block = {};
+      m_block.reserve(N);
+    }
+    m_lastFlush = std::chrono::steady_clock::now();
+    m_pendingCv.notify_one();
+    return true;
+  }
+
+  void rethrowUnlocked() {
+    if (m_error)
+      std::rethrow_exception(std::exchange(m_error, nullptr));
+  }
+
+  void flushLoop() {
+    std::vector<char> frame;
+    std::unique_lock l{m_mutex};
+    for (;;) {
+      m_pendingCv.wait(l, [this] { return m_stop || m_pendingCount != 0; });
+      if (m_pendingCount == 0)
+        return; // Stopped and drained.
+
+      std::vector<char> block = std::move(m_pending[m_pendingHead]);
+      m_pendingHead = (m_pendingHead + 1) % MaxPendingBlocks;
+      --m_pendingCount;
+      m_spaceCv.notify_all();
+      l.unlock();
+
+      frame.clear();
+      details::compress_block(m_codec, block.data(), block.size(), frame);
+      std::exception_ptr error;
+      WriteStart start;
+      try {
+        details::write_bytes(m_file, frame.data(), frame.size());
+        m_writeBehind.written(m_file, frame.size());
+        countFlush(frame.size(), start);
+      } catch (...) {
+        error = std::current_exception();
+      }
+
+      l.lock();
+      if (error && !m_error)
+        m_error = error;
+      ++m_blocksWritten;
+      m_spaceCv.notify_all();
+      block.clear();
+      // Every block in flight fits, so buffers are never freed and
+      // allocated again.
+      if (m_spare.size() <= MaxPendingBlocks)
+        m_spare.push_back(std::move(block));
+    }
+  }
+
+  std::mutex m_mutex;
+  std::condition_variable m_pendingCv;
+  std::condition_variable m_spaceCv;
+  std::filesystem::path m_filePath;
+  details::NativeFile m_file;
+  std::shared_mutex m_fileMutex; // Keeps reopen from closing m_file in a sync
+  BlockCodec m_codec;
+  const Overflow m_overflow;
+  details::WriteBehindTracker m_writeBehind; // Used by the flush thread only
+
+  std::vector<char> m_block;                // Block being filled
+  // Ring of blocks waiting for compression
+  std::array<std::vector<char>, MaxPendingBlocks> m_pending;
+  std::size_t m_pendingHead{0};
+  std::size_t m_pendingCount{0};
+  std::vector<std::vector<char>> m_spare; // Recycled block buffers
+  std::exception_ptr m_error;               // First error of the flush thread
+  std::uint64_t m_blocksHandedOff{0};
+  std::uint64_t m_blocksWritten{0};
+  details::GroupCommit m_groupCommit;
+  bool m_stop{false};
+
+  std::chrono::steady_clock::time_point m_lastFlush{
+      std::chrono::steady_clock::now()};
+  std::thread m_flushThread;
+};
+
+// Decodes a file written by CompressedFileOutputter. Stops at the first
+// incomplete or corrupt block, e.g. the tail left behind by a crash.
+inline std::string decompressFile(const std::filesystem::path &filePath) {
+  std::ifstream in(filePath, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("decompressFile: Failed to open file " +
+                             filePath.string());
+  const std::vector<char> data{std::istreambuf_iterator<char>(in),
+                               std::istreambuf_iterator<char>()};
+  std::string result;
+  std::size_t pos = 0;
+  while (pos < data.size()) {
+    const std::size_t used =
+        details::decompress_block(data.data() + pos, data.size() - pos, result);
+    if (used == 0)
+      break;
+    pos += used;
+  }
+  return result;
+}
+
+namespace outputters {
+
+inline auto CompressedFile(std::filesystem::path filePath,
+                           BlockCodec codec = details::default_codec(),
+                           WriteBehind writeBehind = {},
+                           Overflow overflow = Overflow::Block) {
+  return std::make_shared<CompressedFileOutputter<256 * literals::KiB>>(
+      std::move(filePath), codec, writeBehind, overflow);
+}
+
+template <std::size_t N>
+inline auto CompressedFile(std::filesystem::path filePath, BufferCapacity<N>,
+                           BlockCodec codec = details::default_codec(),
+                           WriteBehind writeBehind = {},
+                           Overflow overflow = Overflow::Block) {
+  return std::make_shared<CompressedFileOutputter<N>>(
+      std::move(filePath), codec, writeBehind, overflow);
+}
+
+} // namespace outputters
+
+} // namespace lfy
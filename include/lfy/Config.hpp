@@ -1,10 +1,553 @@
 // Configuration management as a json file that maps to a C++ class.
 // Power: Specify a logger, outputter, and log level.
+//
+// {
+//   "outputters": {
+//     "main": {"type": "file", "path": "app.log", "bufferSize": "256KiB"},
+//     "console": {"type": "console"}
+//   },
+//   "loggers": {
+//     "": {"level": "info", "outputters": ["main"],
+//          "headers": ["time", "level", "name"], "flusher": "automatic"},
+//     "app.db": {"level": "debug",
+//                "outputters": [{"name": "console", "level": "warn"}]}
+//   }
+// }
+//
+// Outputter types: console, file, compressed and on Linux mapped, uring and
+// direct. Buffer sizes are bytes or strings like "64KiB" and have to be one of
+// SupportedBufferSizes. Loggers are created as inheriting loggers; their
+// settings are added to the ones of their ancestors, as with the Logger API.
+//
+// Applying a configuration replaces the settings of all configured loggers at
+// once. Loggers, which were configured before but are missing now, fall back
+// to their ancestors. Outputters, whose definition did not change, are reused,
+// so their buffered records are kept. If anything in a configuration is
+// invalid, nothing is applied.
+//
+// Mapped and direct outputters trim or rewrite the end of their file when
+// they are released, which is after their successor opened it. A reload can
+// therefore not open the file of a current mapped or direct outputter with a
+// new outputter, e.g. to change its windowSize; it is rejected. Use another
+// path, or remove the outputter in a reload of its own first.
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "CompressedOutputter.hpp"
+#include "HeaderGen.hpp"
+#include "Logger.hpp"
+#include "Outputter.hpp"
+#include "Repository.hpp"
 #include "Types.hpp"
+#include "details/FileWatchWrapper.hpp"
+#include "details/Json.hpp"
 
-namespace lfy {} // namespace lfy
\ No newline at end of file
+#if defined(__linux__)
+#include "DirectOutputter.hpp"
+#include "MappedOutputter.hpp"
+#include "UringOutputter.hpp"
+#endif
+
+namespace lfy {
+
+namespace config {
+
+using details::JsonValue;
+
+// Buffer capacities which can be configured, as each one instantiates the
+// buffered outputters.
+inline constexpr std::array<std::size_t, 9> SupportedBufferSizes = {
+    4 * literals::KiB,   8 * literals::KiB,   16 * literals::KiB,
+    32 * literals::KiB,  64 * literals::KiB,  128 * literals::KiB,
+    256 * literals::KiB, 512 * literals::KiB, 1 * literals::MiB};
+
+[[noreturn]] inline void fail(const std::string &what) {
+  throw std::runtime_error("lfy::config: " + what);
+}
+
+// Rejects unknown members, which are most likely typos.
+inline void check_members(const JsonValue &object, std::string_view context,
+                          std::initializer_list<std::string_view> allowed) {
+  for (const auto &[name, value] : object.asObject()) {
+    bool known = false;
+    for (const std::string_view candidate : allowed)
+      known = known || candidate == name;
+    if (!known)
+      fail("unknown member '" + name + "' in " + std::string(context));
+  }
+}
+
+inline std::string get_string(const JsonValue &object, std::string_view key,
+                              std::string_view context) {
+  const JsonValue *value = object.find(key);
+  if (value == nullptr || !value->isString())
+    fail(std::string(context) + " requires the string '" + std::string(key) +
+         "'");
+  return value->asString();
+}
+
+// Accepts numbers and strings with a B, KiB, MiB or GiB suffix.
+inline std::size_t parse_size(const JsonValue &value) {
+  constexpr std::size_t Max = std::numeric_limits<std::size_t>::max();
+  if (value.isNumber()) {
+    if (value.asNumber() < 0)
+      fail("negative size");
+    // Converting a larger double is undefined
+    if (value.asNumber() >= static_cast<double>(Max))
+      fail("size out of range");
+    return static_cast<std::size_t>(value.asNumber());
+  }
+  const std::string &text = value.asString();
+  std::size_t pos = 0;
+  std::size_t size = 0;
+  while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+    const auto digit = static_cast<std::size_t>(text[pos++] - '0');
+    if (size > (Max - digit) / 10)
+      fail("size out of range in '" + text + "'");
+    size = size * 10 + digit;
+  }
+  const std::string_view unit = std::string_view(text).substr(pos);
+  if (pos == 0)
+    fail("invalid size '" + text + "'");
+  std::size_t multiplier = 0;
+  if (unit.empty() || unit == "B")
+    multiplier = 1;
+  else if (unit == "KiB")
+    multiplier = literals::KiB;
+  else if (unit == "MiB")
+    multiplier = literals::MiB;
+  else if (unit == "GiB")
+    multiplier = literals::GiB;
+  else
+    fail("invalid size unit in '" + text + "'");
+  if (size > Max / multiplier)
+    fail("size out of range in '" + text + "'");
+  return size * multiplier;
+}
+
+inline LogLevel parse_level(const JsonValue &value) {
+  if (auto level = logLevelFromString(value.asString()); level)
+    return *level;
+  fail("unknown level '" + value.asString() + "'");
+}
+
+// Calls fn with the BufferCapacity tag of size.
+template <typename Fn>
+std::shared_ptr<Outputter> with_buffer_capacity(std::size_t size, Fn &&fn) {
+  using literals::KiB;
+  using literals::MiB;
+  switch (size) {
+  case 4 * KiB:
+    return fn(BufferCapacity<4 * KiB>{});
+  case 8 * KiB:
+    return fn(BufferCapacity<8 * KiB>{});
+  case 16 * KiB:
+    return fn(BufferCapacity<16 * KiB>{});
+  case 32 * KiB:
+    return fn(BufferCapacity<32 * KiB>{});
+  case 64 * KiB:
+    return fn(BufferCapacity<64 * KiB>{});
+  case 128 * KiB:
+    return fn(BufferCapacity<128 * KiB>{});
+  case 256 * KiB:
+    return fn(BufferCapacity<256 * KiB>{});
+  case 512 * KiB:
+    return fn(BufferCapacity<512 * KiB>{});
+  case 1 * MiB:
+    return fn(BufferCapacity<1 * MiB>{});
+  }
+  std::string supported;
+  for (const std::size_t candidate : SupportedBufferSizes)
+    supported += (supported.empty() ? "" : ", ") + std::to_string(candidate);
+  fail("unsupported buffer size " + std::to_string(size) + " (supported: " +
+       supported + ")");
+}
+
+inline WriteBehind parse_write_behind(const JsonValue *value) {
+  WriteBehind writeBehind;
+  if (value == nullptr)
+    return writeBehind;
+  check_members(*value, "writeBehind", {"syncBytes", "dropBytes"});
+  if (const JsonValue *syncBytes = value->find("syncBytes"))
+    writeBehind.syncBytes = parse_size(*syncBytes);
+  if (const JsonValue *dropBytes = value->find("dropBytes"))
+    writeBehind.dropBytes = parse_size(*dropBytes);
+  return writeBehind;
+}
+
+inline BlockCodec parse_codec(const JsonValue *value) {
+  if (value == nullptr)
+    return details::default_codec();
+  const std::string &name = value->asString();
+  if (name == "stored")
+    return BlockCodec::Stored;
+  if (name == "lz4")
+    return BlockCodec::Lz4;
+  if (name == "zlib")
+    return BlockCodec::Zlib;
+  fail("unknown codec '" + name + "'");
+}
+
+inline Overflow parse_overflow(const JsonValue *value) {
+  if (value == nullptr)
+    return Overflow::Block;
+  const std::string &name = value->asString();
+  if (name == "block")
+    return Overflow::Block;
+  if (name == "drop")
+    return Overflow::Drop;
+  fail("unknown overflow '" + name + "'");
+}
+
+inline std::shared_ptr<Outputter> make_outputter(const std::string &name,
+                                                 const JsonValue &definition) {
+  const std::string context = "outputter '" + name + "'";
+  const std::string type = get_string(definition, "type", context);
+  const JsonValue *bufferSize = definition.find("bufferSize");
+  const std::size_t capacity =
+      bufferSize != nullptr ? parse_size(*bufferSize) : 64 * literals::KiB;
+
+  if (type == "console") {
+    check_members(definition, context, {"type", "bufferSize"});
+    return outputters::Console(capacity);
+  }
+
+  const std::filesystem::path path = get_string(definition, "path", context);
+  if (type == "file") {
+    check_members(definition, context,
+                  {"type", "path", "bufferSize", "writeBehind"});
+    const WriteBehind writeBehind =
+        parse_write_behind(definition.find("writeBehind"));
+    return with_buffer_capacity(capacity, [&](auto tag) {
+      return outputters::File(path, tag, writeBehind);
+    });
+  }
+  if (type == "compressed") {
+    check_members(definition, context,
+                  {"type", "path", "bufferSize", "codec", "writeBehind",
+                   "overflow"});
+    const BlockCodec codec = parse_codec(definition.find("codec"));
+    const WriteBehind writeBehind =
+        parse_write_behind(definition.find("writeBehind"));
+    const Overflow overflow = parse_overflow(definition.find("overflow"));
+    return with_buffer_capacity(capacity, [&](auto tag) {
+      return outputters::CompressedFile(path, tag, codec, writeBehind,
+                                        overflow);
+    });
+  }
+#if defined(__linux__)
+  if (type == "mapped") {
+    check_members(definition, context,
+                  {"type", "path", "windowSize", "allocationChunk"});
+    const JsonValue *window = definition.find("windowSize");
+    const JsonValue *chunk = definition.find("allocationChunk");
+    return outputters::MappedFile(
+        path, window != nullptr ? parse_size(*window) : 16 * literals::MiB,
+        chunk != nullptr ? parse_size(*chunk) : 64 * literals::MiB);
+  }
+  if (type == "uring") {
+    check_members(definition, context, {"type", "path", "bufferSize"});
+    return with_buffer_capacity(
+        capacity, [&](auto tag) { return outputters::UringFile(path, tag); });
+  }
+  if (type == "direct") {
+    check_members(definition, context, {"type", "path", "bufferSize"});
+    return with_buffer_capacity(
+        capacity, [&](auto tag) { return outputters::DirectFile(path, tag); });
+  }
+#endif
+  fail("unknown type '" + type + "' of " + context);
+}
+
+inline HeaderGenerator make_header(const JsonValue &definition) {
+  if (definition.isString()) {
+    const std::string &name = definition.asString();
+    if (name == "time")
+      return headergen::Time();
+    if (name == "utcTime")
+      return headergen::Time(TimeType::Utc);
+    if (name == "level")
+      return headergen::Level();
+    if (name == "name")
+      return headergen::LoggerName();
+    fail("unknown header '" + name + "'");
+  }
+
+  check_members(definition, "header", {"type", "utc", "format"});
+  if (get_string(definition, "type", "header") != "time")
+    fail("only time headers take options");
+  const JsonValue *utc = definition.find("utc");
+  const JsonValue *format = definition.find("format");
+  return headergen::Time(utc != nullptr && utc->asBool() ? TimeType::Utc
+                                                         : TimeType::Local,
+                         format != nullptr ? format->asString()
+                                           : "%Y-%m-%dT%H:%M:%S%z");
+}
+
+inline Flusher make_flusher(const JsonValue &definition) {
+  if (definition.isString()) {
+    if (definition.asString() == "automatic")
+      return flushers::Automatic();
+    if (definition.asString() == "always")
+      return flushers::Always();
+    fail("unknown flusher '" + definition.asString() + "'");
+  }
+
+  check_members(definition, "flusher", {"everyNthMessage", "lazyTimed"});
+  if (const JsonValue *n = definition.find("everyNthMessage")) {
+    if (n->asNumber() < 1)
+      fail("everyNthMessage must be at least 1");
+    return flushers::EveryNthMessage(static_cast<std::size_t>(n->asNumber()));
+  }
+  if (const JsonValue *seconds = definition.find("lazyTimed"))
+    return flushers::LazyTimed(
+        std::chrono::seconds(static_cast<long long>(seconds->asNumber())));
+  fail("empty flusher");
+}
+
+} // namespace config
+
+// Builds and updates the logger tree from json configurations.
+class Configuration {
+public:
+  // Applies the configuration file. Throws, if it cannot be read or is
+  // invalid, in which case nothing changes.
+  void load(const std::filesystem::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+      config::fail("cannot read " + path.string());
+    const std::string text((std::istreambuf_iterator<char>(in)), {});
+    apply(text);
+  }
+
+  void apply(std::string_view json) {
+    std::lock_guard l{m_mutex};
+    const config::JsonValue root = details::parse_json(json);
+    config::check_members(root, "configuration", {"outputters", "loggers"});
+
+    // Build everything first: opening files is the slow part, and a failure
+    // must not leave a half applied configuration behind.
+    std::unordered_map<std::string, OutputterEntry> outputters;
+    if (const config::JsonValue *definitions = root.find("outputters")) {
+      for (const auto &[name, definition] : definitions->asObject()) {
+        std::string dumped = definition.dump();
+        auto it = m_outputters.find(name);
+        std::shared_ptr<Outputter> outputter;
+        if (it != m_outputters.end() && it->second.definition == dumped) {
+          outputter = it->second.outputter;
+        } else {
+          checkFileUnshared(name, definition);
+          outputter = config::make_outputter(name, definition);
+        }
+        outputters.insert_or_assign(
+            name, OutputterEntry{std::move(dumped),
+                                 memberString(definition, "type"),
+                                 memberString(definition, "path"),
+                                 std::move(outputter)});
+      }
+    }
+
+    std::vector<std::pair<std::string, LoggerSettings>> settings;
+    std::vector<std::string> configured;
+    if (const config::JsonValue *loggers = root.find("loggers")) {
+      for (const auto &[name, definition] : loggers->asObject()) {
+        settings.emplace_back(name, makeSettings(name, definition, outputters));
+        configured.push_back(name);
+      }
+    }
+    for (const std::string &name : m_loggers) {
+      if (std::find(configured.begin(), configured.end(), name) ==
+          configured.end())
+        settings.emplace_back(name, LoggerSettings{});
+    }
+
+    Repository::configure(std::move(settings));
+
+    // No logging call uses the replaced outputters anymore, once configure
+    // returned. Released here, they flush and close their files, a mapped
+    // file is trimmed to its logical length. Those which are still referenced
+    // elsewhere, e.g. through getOutputter, stay open and are flushed.
+    std::vector<std::shared_ptr<Outputter>> replaced;
+    for (auto &[name, entry] : m_outputters) {
+      auto it = outputters.find(name);
+      if (it == outputters.end() || it->second.outputter != entry.outputter)
+        replaced.push_back(std::move(entry.outputter));
+    }
+    m_outputters = std::move(outputters);
+    m_loggers = std::move(configured);
+    for (std::shared_ptr<Outputter> &outputter : replaced) {
+      if (outputter.use_count() > 1)
+        outputter->flush();
+      outputter.reset();
+    }
+  }
+
+  // The outputter configured under name, if any.
+  [[nodiscard]] std::shared_ptr<Outputter>
+  getOutputter(const std::string &name) const {
+    std::lock_guard l{m_mutex};
+    auto it = m_outputters.find(name);
+    return it != m_outputters.end() ? it->second.outputter : nullptr;
+  }
+
+private:
+  struct OutputterEntry {
+    std::string definition; // Serialized json, to detect changes
+    std::string type;
+    std::string path; // Empty for the console
+    std::shared_ptr<Outputter> outputter;
+  };
+
+  static std::string memberString(const config::JsonValue &definition,
+                                  std::string_view key) {
+    const config::JsonValue *member =
+        definition.isObject() ? definition.find(key) : nullptr;
+    return member != nullptr && member->isString() ? member->asString() : "";
+  }
+
+  static bool ownsFileEnd(const std::string &type) {
+    return type == "mapped" || type == "direct";
+  }
+
+  // Throws, if the new outputter name would open the file of a current
+  // mapped or direct outputter, or a new one of these the file of any.
+  void checkFileUnshared(const std::string &name,
+                         const config::JsonValue &definition) const {
+    const std::string type = memberString(definition, "type");
+    const std::string path = memberString(definition, "path");
+    if (path.empty())
+      return;
+    const std::filesystem::path file =
+        std::filesystem::path(path).lexically_normal();
+    for (const auto &[current, entry] : m_outputters) {
+      if ((ownsFileEnd(type) || ownsFileEnd(entry.type)) &&
+          !entry.path.empty() &&
+          std::filesystem::path(entry.path).lexically_normal() == file)
+        config::fail("outputter '" + name + "' opens " + path +
+                     ", which the " + entry.type + " outputter '" + current +
+                     "' still uses");
+    }
+  }
+
+  static LoggerSettings
+  makeSettings(const std::string &name, const config::JsonValue &definition,
+               const std::unordered_map<std::string, OutputterEntry> &all) {
+    const std::string context = "logger '" + name + "'";
+    config::check_members(
+        definition, context,
+        {"level", "outputters", "headers", "flusher", "durability"});
+
+    LoggerSettings settings;
+    if (const config::JsonValue *level = definition.find("level"))
+      settings.m_level = config::parse_level(*level);
+    if (const config::JsonValue *durability = definition.find("durability"))
+      settings.m_durableLevel = config::parse_level(*durability);
+    if (const config::JsonValue *flusher = definition.find("flusher"))
+      settings.m_flushApplier = config::make_flusher(*flusher);
+    if (const config::JsonValue *headers = definition.find("headers"))
+      for (const config::JsonValue &header : headers->asArray())
+        settings.m_headerGenerators.push_back(config::make_header(header));
+
+    if (const config::JsonValue *attached = definition.find("outputters")) {
+      for (const config::JsonValue &attachment : attached->asArray()) {
+        OutputterAttachment entry;
+        std::string outputterName;
+        if (attachment.isString()) {
+          outputterName = attachment.asString();
+        } else {
+          config::check_members(attachment, context, {"name", "level"});
+          outputterName = config::get_string(attachment, "name", context);
+          if (const config::JsonValue *level = attachment.find("level"))
+            entry.m_minLevel = config::parse_level(*level);
+        }
+        auto it = all.find(outputterName);
+        if (it == all.end())
+          config::fail(context + " uses unknown outputter '" + outputterName +
+                       "'");
+        entry.m_outputter = it->second.outputter;
+        settings.m_outputters.push_back(std::move(entry));
+      }
+    }
+    return settings;
+  }
+
+  mutable std::mutex m_mutex;
+  std::unordered_map<std::string, OutputterEntry> m_outputters;
+  std::vector<std::string> m_loggers; // Configured by the last apply
+};
+
+// Loads a configuration file and applies it again, whenever it changes.
+// Reloading happens on a background thread; logging calls keep going with the
+// previous configuration until the new one is complete.
+class ConfigWatcher {
+public:
+  using ErrorHandler = std::function<void(const std::exception &)>;
+
+  // Throws, if the initial configuration cannot be applied. Later errors are
+  // passed to onError and leave the last good configuration in place.
+  explicit ConfigWatcher(std::filesystem::path path, ErrorHandler onError = {})
+      : m_path{std::move(path)}, m_onError{std::move(onError)} {
+    m_configuration.load(m_path);
+    if (!m_watch.open(m_path))
+      config::fail("cannot watch " + m_path.string());
+    m_thread = std::thread([this] { run(); });
+  }
+
+  ConfigWatcher(const ConfigWatcher &) = delete;
+  ConfigWatcher &operator=(const ConfigWatcher &) = delete;
+
+  ~ConfigWatcher() {
+    m_watch.stop();
+    m_thread.join();
+    m_watch.close();
+  }
+
+  // Number of successful reloads, not counting the initial load.
+  [[nodiscard]] std::size_t reloads() const {
+    return m_reloads.load(std::memory_order_relaxed);
+  }
+
+  Configuration &configuration() { return m_configuration; }
+
+private:
+  void run() {
+    while (m_watch.wait()) {
+      try {
+        m_configuration.load(m_path);
+        m_reloads.fetch_add(1, std::memory_order_relaxed);
+      } catch (const std::exception &e) {
+        if (m_onError)
+          m_onError(e);
+      }
+    }
+  }
+
+  std::filesystem::path m_path;
+  ErrorHandler m_onError;
+  Configuration m_configuration;
+  details::FileWatch m_watch;
+  std::atomic<std::size_t> m_reloads{0};
+  std::thread m_thread;
+};
+
+} // namespace lfy
@@ -0,0 +1,257 @@
+// Control channel to manage the loggers of a running process, e.g. to raise
+// one subsystem to debug during an incident:
+//
+//   lfy::ControlServer control{"/run/app/lfy.sock"};
+//
+//   $ lfy-ctl /run/app/lfy.sock level debug app.db
+//
+// Commands, one per connection:
+//   level <level> [prefix]  Sets the level of the inheriting logger prefix,
+//                           or of the root logger "" without prefix. The
+//                           inheriting loggers below it follow, unless
+//                           they set a level of their own. A missing prefix
+//                           logger is created only if there are loggers
+//                           below it. Replies with the number of loggers
+//                           whose level changed.
+//   flush                   Flushes all outputters.
+//   stats                   Prints the levels of all loggers and the metrics
+//                           in the Prometheus text format.
+//   reopen                  Reopens all output files, e.g. after rotation.
+//   profile start [sites]   Starts the volume profiler, see VolumeProfiler;
+//                           at most VolumeProfiler::MaxCapacity sites.
+//   profile stop|reset
+//   top [n]                 Prints the n call sites with most bytes logged.
+//   help                    Lists the commands.
+// The reply ends with a line "ok" or "error: <reason>".
+//
+// The server waits in poll() on its own thread and is only reachable through
+// the socket; logging calls never touch it.
+
+#pragma once
+
+#if !defined(__linux__)
+#error "Control.hpp is only supported on Linux"
+#endif
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Logger.hpp"
+#include "Outputter.hpp"
+#include "Prometheus.hpp"
+#include "Repository.hpp"
+#include "Types.hpp"
+#include "VolumeProfiler.hpp"
+#include "details/ControlSocketLinux.hpp"
+
+namespace lfy {
+
+class ControlServer {
+public:
+  // Listens on the socket at path, replacing a stale socket file. Throws, if
+  // the socket cannot be created.
+  explicit ControlServer(std::filesystem::path path) {
+    if (!m_socket.open(path))
+      throw std::runtime_error("ControlServer: Failed to listen on " +
+                               path.string());
+    m_thread = std::thread([this] { run(); });
+  }
+
+  ControlServer(const ControlServer &) = delete;
+  ControlServer &operator=(const ControlServer &) = delete;
+
+  ~ControlServer() {
+    m_socket.stop();
+    m_thread.join();
+    m_socket.close();
+  }
+
+  // Runs a command as if it was received on the socket, returns the reply.
+  static std::string execute(std::string_view command) {
+    std::vector<std::string_view> args = split(command);
+    if (args.empty())
+      return "error: empty command\n";
+    try {
+      std::string reply;
+      if (args[0] == "level")
+        reply = setLevel(args);
+      else if (args[0] == "flush" && args.size() == 1)
+        reply =
+            forEachOutputter([](Outputter &outputter) { outputter.flush(); });
+      else if (args[0] == "reopen" && args.size() == 1)
+        reply =
+            forEachOutputter([](Outputter &outputter) { outputter.reopen(); });
+      else if (args[0] == "stats" && args.size() == 1)
+        reply = stats();
+      else if (args[0] == "profile")
+        profile(args);
+      else if (args[0] == "top" && args.size() <= 2)
+        reply = top(args.size() == 2 ? parseNumber(args[1]) : 10);
+      else if (args[0] == "help" && args.size() == 1)
+        reply = "level <level> [prefix]\nflush\nstats\nreopen\n"
+                "profile start [sites]\nprofile stop\nprofile reset\n"
+                "top [n]\nhelp\n";
+      else
+        return "error: unknown command, try help\n";
+      return reply + "ok\n";
+    } catch (const std::exception &e) {
+      return "error: " + std::string(e.what()) + "\n";
+    }
+  }
+
+private:
+  void run() {
+    for (int client; (client = m_socket.accept()) >= 0;) {
+      if (std::optional<std::string> line = details::receive_line(client))
+        details::send_all(client, execute(*line));
+      ::close(client);
+    }
+  }
+
+  static std::vector<std::string_view> split(std::string_view line) {
+    std::vector<std::string_view> args;
+    while (true) {
+      const std::size_t begin = line.find_first_not_of(" \t\r");
+      if (begin == std::string_view::npos)
+        return args;
+      line.remove_prefix(begin);
+      const std::size_t end = line.find_first_of(" \t\r");
+      args.push_back(line.substr(0, end));
+      if (end == std::string_view::npos)
+        return args;
+      line.remove_prefix(end);
+    }
+  }
+
+  static std::string setLevel(const std::vector<std::string_view> &args) {
+    if (args.size() < 2 || args.size() > 3)
+      throw std::runtime_error("usage: level <level> [prefix]");
+    const std::optional<LogLevel> level = logLevelFromString(args[1]);
+    if (!level)
+      throw std::runtime_error("unknown level " + std::string(args[1]));
+
+    // Loggers below the prefix, also those created later on, follow it. A
+    // typo matches no logger and must not leave a new one behind.
+    const std::string prefix = args.size() == 3 ? std::string(args[2]) : "";
+    std::shared_ptr<Logger> target;
+    bool below = false;
+    Repository::forEachLogger(prefix,
+                              [&](const std::shared_ptr<Logger> &logger) {
+                                if (logger->getName() == prefix)
+                                  target = logger;
+                                else
+                                  below = true;
+                              });
+    std::string reply;
+    if (target == nullptr) {
+      if (!below)
+        throw std::runtime_error("no logger at or below '" + prefix + "'");
+      target = Repository::getLogger(prefix, Inheritance::Enabled);
+      reply = "created logger " + prefix + "\n";
+    }
+
+    std::vector<std::pair<std::shared_ptr<Logger>, LogLevel>> before;
+    Repository::forEachLogger(prefix,
+                              [&](const std::shared_ptr<Logger> &logger) {
+                                before.emplace_back(logger,
+                                                    logger->getLogLevel());
+                              });
+    target->setLogLevel(*level);
+
+    std::size_t count = 0;
+    for (const auto &[logger, previous] : before)
+      if (logger->getLogLevel() != previous)
+        ++count;
+    return reply + "loggers " + std::to_string(count) + "\n";
+  }
+
+  // Calls fn once for each outputter attached to any logger.
+  template <typename Fn> static std::string forEachOutputter(Fn &&fn) {
+    std::vector<std::shared_ptr<Outputter>> outputters;
+    std::unordered_set<const Outputter *> seen;
+    Repository::forEachLogger("", [&](const std::shared_ptr<Logger> &logger) {
+      for (auto &outputter : logger->getOutputters())
+        if (seen.insert(outputter.get()).second)
+          outputters.push_back(std::move(outputter));
+    });
+    for (const auto &outputter : outputters)
+      fn(*outputter);
+    return "outputters " + std::to_string(outputters.size()) + "\n";
+  }
+
+  static std::size_t parseNumber(std::string_view arg) {
+    std::size_t value = 0;
+    if (arg.empty() || arg.size() > 9 ||
+        arg.find_first_not_of("0123456789") != std::string_view::npos)
+      throw std::runtime_error("not a number: " + std::string(arg));
+    for (const char c : arg)
+      value = value * 10 + static_cast<std::size_t>(c - '0');
+    return value;
+  }
+
+  static void profile(const std::vector<std::string_view> &args) {
+    if (args.size() == 2 && args[1] == "stop")
+      VolumeProfiler::stop();
+    else if (args.size() == 2 && args[1] == "reset")
+      VolumeProfiler::reset();
+    else if (args.size() >= 2 && args.size() <= 3 && args[1] == "start") {
+      const std::size_t sites = args.size() == 3
+                                    ? parseNumber(args[2])
+                                    : VolumeProfiler::DefaultCapacity;
+      if (sites > VolumeProfiler::MaxCapacity)
+        throw std::runtime_error(
+            "at most " + std::to_string(VolumeProfiler::MaxCapacity) +
+            " sites");
+      VolumeProfiler::start(sites);
+    } else
+      throw std::runtime_error("usage: profile start [sites]|stop|reset");
+  }
+
+  // One line per site: share of all bytes, bytes, bytes per second, records,
+  // logger and format string.
+  static std::string top(std::size_t n) {
+    const VolumeReport report = VolumeProfiler::report(n);
+    const double seconds =
+        std::chrono::duration<double>(report.elapsed).count();
+    std::string reply =
+        std::format("# {} bytes {} records in {:.1f}s\n", report.totalBytes,
+                    report.totalCount, seconds);
+    for (const VolumeSite &site : report.sites) {
+      const double share =
+          report.totalBytes == 0 ? 0 : 100.0 * site.bytes / report.totalBytes;
+      const double rate = seconds > 0 ? site.bytes / seconds : 0;
+      reply += std::format("{:5.1f}% {} {:.0f}/s {} \"{}\" \"{}\"\n", share,
+                           site.bytes, rate, site.count, site.logger,
+                           site.format);
+    }
+    return reply;
+  }
+
+  static std::string stats() {
+    std::string reply;
+    Repository::forEachLogger("", [&](const std::shared_ptr<Logger> &logger) {
+      const std::string &name = logger->getName();
+      reply += "# logger \"" + name + "\" level " +
+               std::string(logLevelToString(logger->getLogLevel())) +
+               " outputters " +
+               std::to_string(logger->getAttachments().size()) + "\n";
+    });
+    return reply + prometheus::render(Repository::getMetrics());
+  }
+
+  details::ControlSocket m_socket;
+  std::thread m_thread;
+};
+
+} // namespace lfy
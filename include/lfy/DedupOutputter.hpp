@@ -0,0 +1,129 @@
+// Opt-in stage which collapses consecutive duplicate records in front of an
+// outputter. Records are compared by logger name, level and message body;
+// headers such as the time stamp are ignored. Repeats within the window after
+// the last forwarded record are rejected before the wrapped outputter is
+// touched. They are reported as one summary line in front of the next
+// forwarded record, or by the first flush once the window expired.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "Outputter.hpp"
+#include "Types.hpp"
+
+namespace lfy {
+
+class DedupOutputter : public Outputter {
+public:
+  DedupOutputter(std::shared_ptr<Outputter> outputter,
+                 std::chrono::milliseconds window = std::chrono::seconds(10))
+      : m_outputter{std::move(outputter)}, m_window{window} {}
+
+  ~DedupOutputter() override {
+    std::lock_guard l{m_mutex};
+    if (m_repeats != 0)
+      m_outputter->output(summaryUnlocked());
+  }
+
+  // Messages without record information cannot be told apart from their
+  // headers and are passed through.
+  void output(const std::string &message) override {
+    m_outputter->output(message);
+  }
+
+  void outputRecord(const LogRecord &record) override {
+    const LogMetaData &metaData = record.m_metaData;
+    const std::string_view body = record.body();
+
+    std::unique_lock l{m_mutex};
+    const auto now = metaData.m_timestamp;
+    if (now - m_lastForwarded < m_window && metaData.m_level == m_lastLevel &&
+        body == m_lastBody && metaData.m_loggerName == m_lastLogger) {
+      if (m_repeats++ == 0)
+        m_firstRepeat = now;
+      m_lastRepeat = now;
+      countDrop();
+      return;
+    }
+
+    // Forward the summary and the record under the lock, so no other record
+    // can get in between them.
+    // Assignments reuse the capacity of the strings
+    m_lastLogger = metaData.m_loggerName;
+    m_lastLevel = metaData.m_level;
+    m_lastBody = body;
+    m_lastForwarded = now;
+    if (m_repeats != 0) {
+      m_outputter->output(summaryUnlocked());
+      m_outputter->outputRecord(record);
+      return;
+    }
+    l.unlock();
+    m_outputter->outputRecord(record);
+  }
+
+  std::chrono::steady_clock::time_point lastFlush() override {
+    return m_outputter->lastFlush();
+  }
+
+  // Pending summaries are only emitted once the window expired, so
+  // per-message flushers do not turn every repeat into a summary line.
+  void flush() override {
+    {
+      std::lock_guard l{m_mutex};
+      if (m_repeats != 0 &&
+          std::chrono::system_clock::now() - m_lastForwarded >= m_window)
+        m_outputter->output(summaryUnlocked());
+    }
+    m_outputter->flush();
+  }
+
+  void sync() override { m_outputter->sync(); }
+
+  void reopen() override { m_outputter->reopen(); }
+
+  [[nodiscard]] std::string getName() const override {
+    return "dedup:" + m_outputter->getName();
+  }
+
+private:
+  std::string summaryUnlocked() {
+    const std::chrono::duration<double> span = m_lastRepeat - m_firstRepeat;
+    std::string summary =
+        std::format("last message repeated {} times over {:.3f}s", m_repeats,
+                    span.count());
+    m_repeats = 0;
+    return summary;
+  }
+
+  std::shared_ptr<Outputter> m_outputter;
+  const std::chrono::milliseconds m_window;
+
+  std::mutex m_mutex;
+  // Last forwarded record
+  std::string m_lastLogger;
+  LogLevel m_lastLevel{LogLevel::Info};
+  std::string m_lastBody;
+  std::uint64_t m_repeats{0}; // Suppressed repeats of the last record
+  std::chrono::system_clock::time_point m_lastForwarded{};
+  std::chrono::system_clock::time_point m_firstRepeat{};
+  std::chrono::system_clock::time_point m_lastRepeat{};
+};
+
+namespace outputters {
+
+inline auto Dedup(std::shared_ptr<Outputter> outputter,
+                  std::chrono::milliseconds window = std::chrono::seconds(10)) {
+  return std::make_shared<DedupOutputter>(std::move(outputter), window);
+}
+
+} // namespace outputters
+
+} // namespace lfy
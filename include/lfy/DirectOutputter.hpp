@@ -0,0 +1,203 @@
+// File outputter which bypasses the page cache with O_DIRECT (Linux only).
+// Only whole, aligned blocks are written directly. The unaligned tail stays
+// in the buffer; flush() and the destructor write it through a regular
+// descriptor, and the next direct write of that block overwrites it.
+//
+// If the filesystem does not support O_DIRECT, the same aligned writes go
+// through the page cache.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "Outputter.hpp"
+#include "details/DirectIoLinux.hpp"
+#include "details/MappedFileLinux.hpp"
+
+namespace lfy {
+
+// N is the buffer size, rounded up to a multiple of the device block size.
+template <std::size_t N> class DirectFileOutputter : public Outputter {
+public:
+  DirectFileOutputter(std::filesystem::path filePath)
+      : m_filePath{std::move(filePath)},
+        m_tailFile{details::open_read_write(m_filePath)},
+        m_directFile{details::open_direct(m_filePath)},
+        m_alignment{details::valid(m_tailFile.get())
+                        ? details::direct_io_alignment(m_tailFile.get())
+                        : 4096},
+        m_buffer{bufferSize(m_alignment), m_alignment} {
+    if (!details::valid(m_tailFile.get())) {
+      throw std::runtime_error(
+          "DirectFileOutputter: Failed to open file " + m_filePath.string() +
+          (std::filesystem::exists(m_filePath) ? " (Not enough access rights)"
+                                               : ""));
+    }
+    m_direct = details::valid(m_directFile.get());
+    if (!m_direct)
+      m_directFile =
+          details::UniqueFile{details::open_read_write(m_filePath)};
+    loadTailUnlocked();
+  }
+
+  ~DirectFileOutputter() override {
+    std::lock_guard l{m_mutex};
+    try {
+      flushUnlocked();
+    } catch (const std::runtime_error &) {
+    }
+  }
+
+  void output(const std::string &message) override {
+    std::lock_guard l{m_mutex};
+    append(message.data(), message.size());
+    append("\n", 1);
+  }
+
+  std::chrono::steady_clock::time_point lastFlush() override {
+    std::lock_guard l{m_mutex};
+    return m_lastFlush;
+  }
+
+  void flush() override {
+    std::lock_guard l{m_mutex};
+    flushUnlocked();
+  }
+
+  // O_DIRECT skips the page cache, but not the device cache or metadata.
+  void sync() override {
+    flush();
+    m_groupCommit.commit([this] {
+      std::shared_lock f{m_fileMutex};
+      details::sync_data(m_tailFile.get());
+    });
+  }
+
+  [[nodiscard]] std::string getName() const override {
+    return m_filePath.string();
+  }
+
+  // The partial last block stays in the old file, the buffer continues with
+  // the one of the new file.
+  void reopen() override {
+    std::lock_guard l{m_mutex};
+    flushUnlocked();
+    details::UniqueFile tailFile{details::open_read_write(m_filePath)};
+    details::UniqueFile directFile{m_direct
+                                       ? details::open_direct(m_filePath)
+                                       : details::open_read_write(m_filePath)};
+    if (!details::valid(tailFile.get()) || !details::valid(directFile.get()))
+      throw std::runtime_error("DirectFileOutputter: Failed to reopen file " +
+                               m_filePath.string());
+    {
+      std::lock_guard f{m_fileMutex};
+      m_tailFile = std::move(tailFile);
+      m_directFile = std::move(directFile);
+    }
+    loadTailUnlocked();
+  }
+
+  [[nodiscard]] bool usesDirectIo() const { return m_direct; }
+
+private:
+  static std::size_t bufferSize(std::size_t alignment) {
+    const std::size_t rounded = (N + alignment - 1) / alignment * alignment;
+    return std::max(rounded, 2 * alignment);
+  }
+
+  // Continues the partial last block of an existing file.
+  void loadTailUnlocked() {
+    const std::uint64_t size = details::file_size(m_tailFile.get());
+    m_bufferOffset = size / m_alignment * m_alignment;
+    m_used = details::read_bytes_at(m_tailFile.get(), m_buffer.data(),
+                                    size - m_bufferOffset, m_bufferOffset);
+    m_tailWritten = m_used;
+  }
+
+  // Copies data into the buffer, writing out full blocks whenever it fills.
+  // Messages larger than the buffer are streamed through it in pieces.
+  void append(const char *data, std::size_t len) {
+    while (len != 0) {
+      if (m_used == m_buffer.size())
+        writeBlocksUnlocked();
+      const std::size_t chunk = std::min(len, m_buffer.size() - m_used);
+      std::memcpy(m_buffer.data() + m_used, data, chunk);
+      m_used += chunk;
+      data += chunk;
+      len -= chunk;
+    }
+  }
+
+  // Writes all complete blocks directly and moves the tail to the front.
+  void writeBlocksUnlocked() {
+    const std::size_t blocks = m_used / m_alignment * m_alignment;
+    if (blocks == 0)
+      return;
+    WriteStart start;
+    details::write_bytes_at(m_directFile.get(), m_buffer.data(), blocks,
+                            m_bufferOffset);
+    countFlush(blocks, start);
+    m_used -= blocks;
+    std::memmove(m_buffer.data(), m_buffer.data() + blocks, m_used);
+    m_bufferOffset += blocks;
+    m_tailWritten = 0;
+    m_lastFlush = std::chrono::steady_clock::now();
+  }
+
+  void flushUnlocked() {
+    writeBlocksUnlocked();
+    if (m_used == m_tailWritten)
+      return;
+    // The tail cannot be written with O_DIRECT; it keeps its place in the
+    // buffer and is rewritten as part of the next full block.
+    WriteStart start;
+    details::write_bytes_at(m_tailFile.get(), m_buffer.data(), m_used,
+                            m_bufferOffset);
+    countFlush(m_used, start);
+    m_tailWritten = m_used;
+    m_lastFlush = std::chrono::steady_clock::now();
+  }
+
+  std::mutex m_mutex;
+  std::filesystem::path m_filePath;
+  details::UniqueFile m_tailFile;   // Buffered descriptor for the tail
+  details::UniqueFile m_directFile; // O_DIRECT descriptor for full blocks
+  std::shared_mutex m_fileMutex;    // Keeps reopen from closing in a sync
+  bool m_direct{false};
+  const std::size_t m_alignment;
+
+  details::AlignedBuffer m_buffer;
+  std::size_t m_used{0};           // Valid bytes in the buffer
+  std::size_t m_tailWritten{0};    // Bytes of the tail already in the file
+  std::uint64_t m_bufferOffset{0}; // File offset of the buffer start
+  details::GroupCommit m_groupCommit;
+
+  std::chrono::steady_clock::time_point m_lastFlush{
+      std::chrono::steady_clock::now()};
+};
+
+namespace outputters {
+
+inline auto DirectFile(std::filesystem::path filePath) {
+  return std::make_shared<DirectFileOutputter<256 * literals::KiB>>(
+      std::move(filePath));
+}
+
+template <std::size_t N>
+inline auto DirectFile(std::filesystem::path filePath, BufferCapacity<N>) {
+  return std::make_shared<DirectFileOutputter<N>>(std::move(filePath));
+}
+
+} // namespace outputters
+
+} // namespace lfy
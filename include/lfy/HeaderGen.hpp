@@ -1,8 +1,12 @@
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <ctime>
 #include <format>
-#include <iomanip>
+#include <optional>
 #include <string>
 #include <unordered_map>
 
@@ -28,6 +32,9 @@ struct TimeCache {
                                  // "2024-10-05T14:23:45+0200")
   std::chrono::system_clock::time_point
       lastTimePoint; // Last time point when the time was formatted
+  // The format with %z replaced, for the offset it was resolved with
+  std::string resolvedFormat;
+  std::optional<int> resolvedOffset;
 };
 
 inline std::string toNumericUtcOffset(int offsetInMinutes) {
@@ -40,9 +47,9 @@ inline std::string toNumericUtcOffset(int offsetInMinutes) {
   return std::format("{}{:02}:{:02}", sign, hours, minutes);
 }
 
-inline std::string toFormattedTime(const std::string &fmt, const std::tm &tm,
-                                   int timeZoneOffset) {
-  // Handle %z manually, as std::put_time may not portably support it.
+// Handle %z manually, as std::strftime may not portably support it.
+inline std::string resolveTimeFormat(const std::string &fmt,
+                                     int timeZoneOffset) {
   auto fmtCopy = fmt;
   std::string::size_type pos = 0;
   while ((pos = fmtCopy.find("%z", pos)) != std::string::npos) {
@@ -50,9 +57,38 @@ inline std::string toFormattedTime(const std::string &fmt, const std::tm &tm,
     fmtCopy.replace(pos, 2, offsetStr);
     pos += offsetStr.size();
   }
-  std::ostringstream oss;
-  oss << std::put_time(&tm, fmtCopy.data());
-  return oss.str();
+  return fmtCopy;
+}
+
+// Formats into result, whose capacity is reused. Expects a resolved format.
+inline void formatTimeInto(std::string &result,
+                           const std::string &resolvedFormat,
+                           const std::tm &tm) {
+  // strftime returns 0 for an empty result, too. A space appended to the
+  // format makes every result non-empty, so 0 means that it did not fit.
+  // The string keeps its capacity, steady state does not allocate.
+  thread_local std::string format;
+  format.assign(resolvedFormat).push_back(' ');
+  std::array<char, 128> buffer;
+  std::size_t size =
+      std::strftime(buffer.data(), buffer.size(), format.c_str(), &tm);
+  if (size != 0) {
+    result.assign(buffer.data(), size - 1);
+    return;
+  }
+  for (std::size_t capacity = 2 * buffer.size();
+       size == 0 && capacity <= 64 * 1024; capacity *= 2) {
+    result.resize(capacity);
+    size = std::strftime(result.data(), capacity, format.c_str(), &tm);
+  }
+  result.resize(size != 0 ? size - 1 : 0);
+}
+
+inline std::string toFormattedTime(const std::string &fmt, const std::tm &tm,
+                                   int timeZoneOffset) {
+  std::string result;
+  formatTimeInto(result, resolveTimeFormat(fmt, timeZoneOffset), tm);
+  return result;
 }
 } // namespace details
 
@@ -88,15 +124,23 @@ inline auto _InternalTime(const std::string &fmt, const LogMetaData &metaData,
   }
 
   const std::time_t t = std::chrono::system_clock::to_time_t(now);
-  const std::tm tm = (timeType == TimeType::Local) ? ::details::toLocalTm(t)
-                                                   : ::details::toUtcTm(t);
+  const std::tm tm = (timeType == TimeType::Local) ? details::toLocalTm(t)
+                                                   : details::toUtcTm(t);
 
   if (timeType == TimeType::Local)
-    cachedLocalTimeZoneOffset = ::details::getLocalTimeZoneOffsetMinutes(tm);
-
-  std::string formattedTime = details::toFormattedTime(
-      fmt, tm, (timeType == TimeType::Local) ? cachedLocalTimeZoneOffset : 0);
-  cachedTime = details::TimeCache{std::move(formattedTime), now};
+    cachedLocalTimeZoneOffset = details::getLocalTimeZoneOffsetMinutes(tm);
+
+  // Refreshed in place, which allocates only while the cache is built up or
+  // the time zone offset changes.
+  const int offset =
+      (timeType == TimeType::Local) ? cachedLocalTimeZoneOffset : 0;
+  if (cachedTime.resolvedOffset != offset) {
+    cachedTime.resolvedFormat = details::resolveTimeFormat(fmt, offset);
+    cachedTime.resolvedOffset = offset;
+  }
+  details::formatTimeInto(cachedTime.lastFormattedTime,
+                          cachedTime.resolvedFormat, tm);
+  cachedTime.lastTimePoint = now;
   buffer.append(cachedTime.lastFormattedTime);
 }
 
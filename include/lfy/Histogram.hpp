@@ -0,0 +1,140 @@
+// Latency histograms of the logging pipeline stages. Recording is compiled
+// in with LFY_LATENCY_HISTOGRAMS only; without it, the stopwatch is an empty
+// type and all recording calls are empty inline functions.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace lfy {
+
+// Log-linear histogram of durations in nanoseconds, in the spirit of
+// HdrHistogram: values are grouped by their highest set bit, and each power of
+// two is split into SubBuckets linear buckets. Reported values are the upper
+// bounds of their buckets, which are less than 1 / SubBuckets too high.
+class LatencyHistogram {
+public:
+  static constexpr unsigned SubBucketBits = 3;
+  static constexpr std::size_t SubBuckets = std::size_t{1} << SubBucketBits;
+  static constexpr std::size_t Buckets = (64 - SubBucketBits + 1) * SubBuckets;
+  // Concurrent recorders are spread over this many copies.
+  static constexpr std::size_t Shards = 4;
+
+  struct Snapshot {
+    [[nodiscard]] std::uint64_t count() const {
+      std::uint64_t total = 0;
+      for (const std::uint64_t n : counts)
+        total += n;
+      return total;
+    }
+
+    // Smallest recorded value (as bucket upper bound) which is at least as
+    // large as the given fraction of all values, e.g. 0.99 for the p99.
+    [[nodiscard]] std::uint64_t valueAt(double quantile) const {
+      const std::uint64_t total = count();
+      if (total == 0)
+        return 0;
+      auto rank = static_cast<std::uint64_t>(quantile * total + 0.5);
+      rank = rank == 0 ? 1 : (rank > total ? total : rank);
+      std::uint64_t seen = 0;
+      for (std::size_t i = 0; i < Buckets; ++i) {
+        seen += counts[i];
+        if (seen >= rank)
+          return upperBound(i);
+      }
+      return upperBound(Buckets - 1);
+    }
+
+    std::array<std::uint64_t, Buckets> counts{};
+    std::uint64_t sum{0}; // Nanoseconds
+  };
+
+  void record(std::uint64_t nanoseconds) {
+    Shard &shard = m_shards[shardIndex()];
+    shard.counts[bucketOf(nanoseconds)].fetch_add(1,
+                                                  std::memory_order_relaxed);
+    shard.sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] Snapshot read() const {
+    Snapshot snapshot;
+    for (const Shard &shard : m_shards) {
+      for (std::size_t i = 0; i < Buckets; ++i)
+        snapshot.counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+      snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+    }
+    return snapshot;
+  }
+
+  static constexpr std::size_t bucketOf(std::uint64_t value) {
+    if (value < SubBuckets)
+      return static_cast<std::size_t>(value);
+    const auto shift =
+        static_cast<unsigned>(std::bit_width(value)) - 1 - SubBucketBits;
+    return (shift + 1) * SubBuckets +
+           static_cast<std::size_t>((value >> shift) - SubBuckets);
+  }
+
+  static constexpr std::uint64_t upperBound(std::size_t bucket) {
+    if (bucket < SubBuckets)
+      return bucket;
+    const std::size_t shift = bucket / SubBuckets - 1;
+    const std::uint64_t lower = std::uint64_t{SubBuckets + bucket % SubBuckets}
+                                << shift;
+    return lower + ((std::uint64_t{1} << shift) - 1);
+  }
+
+private:
+  struct alignas(64) Shard {
+    std::array<std::atomic<std::uint64_t>, Buckets> counts{};
+    std::atomic<std::uint64_t> sum{0};
+  };
+
+  static std::size_t shardIndex() {
+    static std::atomic<std::size_t> next{0};
+    thread_local const std::size_t shard =
+        next.fetch_add(1, std::memory_order_relaxed) % Shards;
+    return shard;
+  }
+
+  std::array<Shard, Shards> m_shards{};
+};
+
+namespace details {
+
+#if defined(LFY_LATENCY_HISTOGRAMS)
+
+// Measures consecutive stages; lap() returns the nanoseconds since the
+// previous lap (or construction).
+class Stopwatch {
+public:
+  std::uint64_t lap() {
+    const auto now = std::chrono::steady_clock::now();
+    const auto elapsed = now - m_last;
+    m_last = now;
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+
+private:
+  std::chrono::steady_clock::time_point m_last{
+      std::chrono::steady_clock::now()};
+};
+
+#else
+
+class Stopwatch {
+public:
+  constexpr std::uint64_t lap() { return 0; }
+};
+
+#endif
+
+} // namespace details
+
+} // namespace lfy
@@ -2,16 +2,27 @@
 // Provides an interface to publish log messages to one outputter
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <format>
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <string>
 #include <vector>
 
+#include "Metrics.hpp"
 #include "Outputter.hpp"
 #include "Types.hpp"
+#include "VolumeProfiler.hpp"
+#include "details/Epoch.hpp"
+#include "details/Probes.hpp"
 
 namespace lfy {
 
@@ -21,6 +32,22 @@ using HeaderGenerator =
 
 using Flusher = std::function<void(const std::shared_ptr<Outputter>)>;
 
+// Decides per record whether an outputter receives it. Evaluated before the
+// record is formatted, hence it only sees the metadata.
+using RecordFilter = std::function<bool(const LogMetaData &)>;
+
+// An outputter as attached to a logger, with its own level threshold and an
+// optional filter.
+struct OutputterAttachment {
+  bool accepts(const LogMetaData &metaData) const {
+    return metaData.m_level >= m_minLevel && (!m_filter || m_filter(metaData));
+  }
+
+  std::shared_ptr<Outputter> m_outputter;
+  LogLevel m_minLevel{LogLevel::Debug};
+  RecordFilter m_filter{};
+};
+
 namespace flushers {
 
 // Never manually flush the outputter. Let the outputter manage its own flushing
@@ -34,18 +61,14 @@ inline constexpr auto Always() {
 }
 
 // Flushes every N messages logged through the outputter.
-inline constexpr auto EveryNthMessage(std::size_t n) {
-  struct EveryN {
-    std::size_t n;
-    std::atomic<std::size_t> counter{0};
-    void operator()(const std::shared_ptr<Outputter> &outputter) {
-      // Each call increments; flush when reaching multiple of n.
-      if (counter.fetch_add(1, std::memory_order_relaxed) % n == (n - 1))
-        outputter->flush();
-    }
+inline auto EveryNthMessage(std::size_t n) {
+  // The counter is shared, as flushers are copied into std::function.
+  auto counter = std::make_shared<std::atomic<std::size_t>>(0);
+  return [n, counter](const std::shared_ptr<Outputter> &outputter) {
+    // Each call increments; flush when reaching multiple of n.
+    if (counter->fetch_add(1, std::memory_order_relaxed) % n == (n - 1))
+      outputter->flush();
   };
-
-  return EveryN{n};
 }
 
 // Flushes, if the time since last flush exceeds the threshold. Does flush
@@ -73,47 +96,219 @@ public:
                      const std::vector<HeaderGenerator> &headers,
                      const std::format_string<Args...> &fmt,
                      Args &&...args) const {
+    std::size_t bodyOffset = 0;
+    return formatRecord(metaData, headers, bodyOffset, fmt,
+                        std::forward<Args>(args)...);
+  }
+
+  // Like format, but additionally reports the offset at which the message
+  // body starts, i.e. the length of all headers.
+  template <typename... Args>
+  std::string formatRecord(const LogMetaData &metaData,
+                           const std::vector<HeaderGenerator> &headers,
+                           std::size_t &bodyOffset,
+                           const std::format_string<Args...> &fmt,
+                           Args &&...args) const {
+    std::string result = formatHeaders<Args...>(metaData, headers, fmt);
+    bodyOffset = result.size();
+    formatBody(result, fmt, std::forward<Args>(args)...);
+    return result;
+  }
+
+  // First stage of formatRecord: a string with all headers, which reserves
+  // space for the body as well.
+  template <typename... Args>
+  std::string formatHeaders(const LogMetaData &metaData,
+                            const std::vector<HeaderGenerator> &headers,
+                            const std::format_string<Args...> &fmt) const {
+    std::string result;
+    appendHeaders<Args...>(result, metaData, headers, fmt);
+    return result;
+  }
 
-    size_t estimated_size = 0;
+  // Like formatHeaders, but appends to result, e.g. a reused buffer. Reserves
+  // only if its capacity falls short of the estimated record size.
+  template <typename... Args>
+  void appendHeaders(std::string &result, const LogMetaData &metaData,
+                     const std::vector<HeaderGenerator> &headers,
+                     const std::format_string<Args...> &fmt) const {
+    size_t estimated_size = result.size();
     constexpr size_t avg_header_len = 32; // date, level, logger name
     constexpr size_t header_overhead = 4; // "[{}] "
     constexpr size_t avg_msg_len = 64;    // assumption: mostly short messages
 
     estimated_size += headers.size() * (avg_header_len + header_overhead);
-    estimated_size += avg_msg_len;
+    if constexpr (sizeof...(Args) == 0)
+      estimated_size += fmt.get().size();
+    else
+      estimated_size += avg_msg_len;
 
-    std::string result;
     result.reserve(estimated_size);
     for (const auto &headerGenerator : headers) {
       result.push_back('[');
       headerGenerator(metaData, result);
       result.append("] ");
     }
+  }
+
+  // Second stage of formatRecord: appends the message body.
+  template <typename... Args>
+  void formatBody(std::string &result, const std::format_string<Args...> &fmt,
+                  Args &&...args) const {
+    // Plain messages without arguments or escaped braces are copied verbatim
+    if constexpr (sizeof...(Args) == 0) {
+      if (fmt.get().find_first_of("{}") == std::string_view::npos) {
+        result.append(fmt.get());
+        return;
+      }
+    }
     std::format_to(std::back_inserter(result), fmt,
                    std::forward<Args>(args)...);
-    return result;
   }
+};
 
-  template <>
-  std::string format<>(const LogMetaData &metaData,
-                       const std::vector<HeaderGenerator> &headers,
-                       const std::format_string<> &msg) const {
-    constexpr size_t avg_header_len = 32; // date, level, logger name
-    constexpr size_t header_overhead = 4; // "[{}] "
+// Effective configuration of a logger: its own settings combined with the
+// ones of its ancestors. Immutable once published; a logging call works with
+// one snapshot from start to end. Replaced configurations are destroyed, and
+// release their outputters, once no logging call uses them anymore.
+struct LoggerConfig {
+  // Whether a record of this level passes the logger level and the level of
+  // at least one outputter.
+  [[nodiscard]] bool isEnabled(LogLevel level) const {
+    return m_level <= level && m_minOutputterLevel <= level;
+  }
 
-    const size_t estimated_size =
-        headers.size() * (avg_header_len + header_overhead) + msg.get().size();
+  std::vector<OutputterAttachment> m_outputters;
+  std::vector<HeaderGenerator> m_headerGenerators;
+  [[no_unique_address]] LogFormatter m_formatter{};
+  LogLevel m_level{LogLevel::Info};
+  // Lowest level any attached outputter accepts
+  LogLevel m_minOutputterLevel{LogLevel::NumberOfLevels};
+  // NumberOfLevels disables durability
+  LogLevel m_durableLevel{LogLevel::NumberOfLevels};
+  Flusher m_flushApplier{flushers::Automatic()};
+  // Identifies the configuration, as the address of a destroyed one may be
+  // reused. 0 for the defaults.
+  std::uint64_t m_serial{0};
+};
 
-    std::string result;
-    result.reserve(estimated_size);
-    for (const auto &headerGenerator : headers) {
-      result.push_back('[');
-      headerGenerator(metaData, result);
-      result.append("] ");
+namespace details {
+
+// Incremented after every configuration change of any logger. Loggers
+// compare it with the generation of their cached configuration, so
+// resolving configurations is only done after something changed.
+inline std::atomic<std::uint64_t> configGeneration{1};
+
+// Serializes settings changes of all loggers, which take it exclusively.
+// Resolving configurations takes it shared, so loggers resolve in parallel
+// after a change; logging calls take it only then.
+inline std::shared_mutex &config_mutex() {
+  static std::shared_mutex mutex;
+  return mutex;
+}
+
+// Serializes the rebuilds of a configuration from a logger's own settings.
+// A small stripe keyed by the logger's address, so loggers need no mutex of
+// their own and different loggers mostly rebuild in parallel.
+inline std::mutex &resolve_mutex(const void *logger) {
+  static constexpr std::size_t Stripes = 16;
+  struct alignas(64) Stripe {
+    std::mutex mutex;
+  };
+  static std::array<Stripe, Stripes> stripes;
+  const auto address = reinterpret_cast<std::uintptr_t>(logger);
+  return stripes[(address / alignof(std::max_align_t)) % Stripes].mutex;
+}
+
+// Records are formatted into a string per thread, which keeps its capacity
+// from one record to the next, so logging stops allocating once the string
+// grew to the usual record size. A logging call nested in another one, e.g.
+// by an outputter, formats into a string of its own.
+class RecordBuffer {
+public:
+  RecordBuffer() : m_shared{!slot().inUse} {
+    if (m_shared) {
+      slot().inUse = true;
+      slot().text.clear();
     }
-    result.append(msg.get());
-    return result;
   }
+
+  ~RecordBuffer() {
+    if (!m_shared)
+      return;
+    // An exceptionally large record does not pin its memory
+    if (slot().text.capacity() > MaxRetained)
+      std::string().swap(slot().text);
+    slot().inUse = false;
+  }
+
+  RecordBuffer(const RecordBuffer &) = delete;
+  RecordBuffer &operator=(const RecordBuffer &) = delete;
+
+  std::string &text() { return m_shared ? slot().text : m_own; }
+
+private:
+  static constexpr std::size_t MaxRetained = 64 * 1024;
+
+  struct Slot {
+    std::string text;
+    bool inUse{false};
+  };
+
+  static Slot &slot() {
+    thread_local Slot slot;
+    return slot;
+  }
+
+  bool m_shared;
+  std::string m_own;
+};
+
+// Configuration of loggers without parent and without own settings.
+inline const LoggerConfig &default_config() {
+  static const LoggerConfig config{};
+  return config;
+}
+
+inline std::uint64_t next_config_serial() {
+  static std::atomic<std::uint64_t> serial{0};
+  return serial.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+} // namespace details
+
+// Settings of a single logger. Unset values are inherited from the parent,
+// outputters and header generators are added to the ones of the parent.
+struct LoggerSettings {
+  [[nodiscard]] bool empty() const {
+    return m_outputters.empty() && m_headerGenerators.empty() && !m_level &&
+           !m_durableLevel && !m_flushApplier;
+  }
+
+  void applyTo(LoggerConfig &config) const {
+    config.m_outputters.insert(config.m_outputters.end(), m_outputters.begin(),
+                               m_outputters.end());
+    config.m_headerGenerators.insert(config.m_headerGenerators.end(),
+                                     m_headerGenerators.begin(),
+                                     m_headerGenerators.end());
+    if (m_level)
+      config.m_level = *m_level;
+    if (m_durableLevel)
+      config.m_durableLevel = *m_durableLevel;
+    if (m_flushApplier)
+      config.m_flushApplier = *m_flushApplier;
+
+    config.m_minOutputterLevel = LogLevel::NumberOfLevels;
+    for (const auto &attachment : config.m_outputters)
+      config.m_minOutputterLevel =
+          std::min(config.m_minOutputterLevel, attachment.m_minLevel);
+  }
+
+  std::vector<OutputterAttachment> m_outputters;
+  std::vector<HeaderGenerator> m_headerGenerators;
+  std::optional<LogLevel> m_level;
+  std::optional<LogLevel> m_durableLevel;
+  std::optional<Flusher> m_flushApplier;
 };
 
 class Repository;
@@ -123,71 +318,92 @@ class Logger {
 public:
   Logger(const Logger &) = delete;
   Logger &operator=(const Logger &) = delete;
+  ~Logger() { delete m_counters.load(std::memory_order_relaxed); }
 
   void log(const std::string &message) {
-    for (const auto &outputter : m_outputters) {
-      outputter->output(message);
-      m_flushApplier(outputter);
+    const details::EpochGuard guard;
+    const LoggerConfig &config = currentConfig();
+    for (const auto &attachment : config.m_outputters) {
+      attachment.m_outputter->output(message);
+      config.m_flushApplier(attachment.m_outputter);
     }
   }
 
+  template <typename... Args>
+  void log(LogLevel level, std::format_string<Args...> fmt, Args &&...args) {
+    logAt(level, fmt, std::forward<Args>(args)...);
+  }
+
+  // Whether a record of this level passes the logger level and the level of
+  // at least one outputter. Filters may still reject it.
+  [[nodiscard]] bool isEnabled(LogLevel level) const {
+    const details::EpochGuard guard;
+    return currentConfig().isEnabled(level);
+  }
+
   template <typename... Args>
   void debug(std::format_string<Args...> fmt, Args &&...args) {
-    if (m_level > LogLevel::Debug)
-      return;
-    LogMetaData metaData{m_name, LogLevel::Debug};
-    log(m_formatter.format(metaData, m_headerGenerators, fmt,
-                           std::forward<Args>(args)...));
+    logAt(LogLevel::Debug, fmt, std::forward<Args>(args)...);
   };
 
   template <typename... Args>
   void info(std::format_string<Args...> fmt, Args &&...args) {
-    if (m_level > LogLevel::Info)
-      return;
-    LogMetaData metaData{m_name, LogLevel::Info};
-    log(m_formatter.format(metaData, m_headerGenerators, fmt,
-                           std::forward<Args>(args)...));
+    logAt(LogLevel::Info, fmt, std::forward<Args>(args)...);
   };
 
   template <typename... Args>
   void warn(std::format_string<Args...> fmt, Args &&...args) {
-    if (m_level > LogLevel::Warn)
-      return;
-    LogMetaData metaData{m_name, LogLevel::Warn};
-    log(m_formatter.format(metaData, m_headerGenerators, fmt,
-                           std::forward<Args>(args)...));
+    logAt(LogLevel::Warn, fmt, std::forward<Args>(args)...);
   };
 
   template <typename... Args>
   void error(std::format_string<Args...> fmt, Args &&...args) {
-    if (m_level > LogLevel::Error)
-      return;
-    LogMetaData metaData{m_name, LogLevel::Error};
-    log(m_formatter.format(metaData, m_headerGenerators, fmt,
-                           std::forward<Args>(args)...));
+    logAt(LogLevel::Error, fmt, std::forward<Args>(args)...);
   };
 
-  Logger &addOutputter(std::shared_ptr<Outputter> outputter) {
-    std::lock_guard lock(m_mutex);
-    m_outputters.push_back(std::shared_ptr<Outputter>(std::move(outputter)));
-    return *this;
+  // Attaches an outputter, which only receives records of at least minLevel
+  // that pass the filter (if any). Descendants receive it as well.
+  Logger &addOutputter(std::shared_ptr<Outputter> outputter,
+                       LogLevel minLevel = LogLevel::Debug,
+                       RecordFilter filter = {}) {
+    return changeSettings([&](Settings &settings) {
+      settings.m_outputters.push_back(OutputterAttachment{
+          std::move(outputter), minLevel, std::move(filter)});
+    });
   }
 
+  // Header generators are appended to the ones of the ancestors.
   Logger &addHeaderGenerator(HeaderGenerator generator) {
-    std::lock_guard l{m_mutex};
-    m_headerGenerators.push_back(std::move(generator));
-    return *this;
+    return changeSettings([&](Settings &settings) {
+      settings.m_headerGenerators.push_back(std::move(generator));
+    });
   }
 
+  // Overrides the level of the ancestors, for this logger and all its
+  // descendants which did not set their own.
   Logger &setLogLevel(LogLevel level) {
-    m_level = level;
-    return *this;
+    return changeSettings(
+        [&](Settings &settings) { settings.m_level = level; });
+  }
+
+  // Records at or above this level are on stable storage before the logging
+  // call returns. Concurrent callers on the same outputter share one sync.
+  Logger &setDurability(LogLevel level) {
+    return changeSettings(
+        [&](Settings &settings) { settings.m_durableLevel = level; });
+  }
+
+  // Stops waiting for stable storage, flushing is left to the flusher again.
+  Logger &clearDurability() {
+    return changeSettings([](Settings &settings) {
+      settings.m_durableLevel = LogLevel::NumberOfLevels;
+    });
   }
 
   Logger &setFlusher(Flusher flushApplier) {
-    std::lock_guard l{m_mutex};
-    m_flushApplier = std::move(flushApplier);
-    return *this;
+    return changeSettings([&](Settings &settings) {
+      settings.m_flushApplier = std::move(flushApplier);
+    });
   }
 
   [[nodiscard]] const std::string &getName() const {
@@ -195,47 +411,287 @@ public:
     return m_name;
   }
 
+  // Getters report the effective configuration, including inherited
+  // settings.
   [[nodiscard]] LogFormatter getFormatter() const {
-    std::lock_guard l{m_mutex};
-    return m_formatter;
+    const details::EpochGuard guard;
+    return currentConfig().m_formatter;
   }
 
   [[nodiscard]] std::vector<std::shared_ptr<Outputter>> getOutputters() const {
-    std::lock_guard l{m_mutex};
-    return m_outputters;
+    const details::EpochGuard guard;
+    const LoggerConfig &config = currentConfig();
+    std::vector<std::shared_ptr<Outputter>> outputters;
+    outputters.reserve(config.m_outputters.size());
+    for (const auto &attachment : config.m_outputters)
+      outputters.push_back(attachment.m_outputter);
+    return outputters;
+  }
+
+  [[nodiscard]] std::vector<OutputterAttachment> getAttachments() const {
+    const details::EpochGuard guard;
+    return currentConfig().m_outputters;
   }
 
   [[nodiscard]] std::vector<HeaderGenerator> getHeaderGenerators() const {
-    std::lock_guard l{m_mutex};
-    return m_headerGenerators;
+    const details::EpochGuard guard;
+    return currentConfig().m_headerGenerators;
   }
 
-  [[nodiscard]] LogLevel getLogLevel() const { return m_level; }
+  [[nodiscard]] LogLevel getLogLevel() const {
+    const details::EpochGuard guard;
+    return currentConfig().m_level;
+  }
 
   [[nodiscard]] Flusher getFlusher() const {
-    std::lock_guard l{m_mutex};
-    return m_flushApplier;
+    const details::EpochGuard guard;
+    return currentConfig().m_flushApplier;
+  }
+
+  [[nodiscard]] LogLevel getDurability() const {
+    const details::EpochGuard guard;
+    return currentConfig().m_durableLevel;
+  }
+
+  [[nodiscard]] LoggerMetrics getMetrics() const {
+    LoggerMetrics metrics{m_name};
+    if (const auto *counters = m_counters.load(std::memory_order_acquire)) {
+      const auto values = counters->read();
+      std::copy_n(values.begin(), metrics.messages.size(),
+                  metrics.messages.begin());
+      metrics.bytesFormatted = values[details::LoggerCounters::BytesFormatted];
+#if defined(LFY_LATENCY_HISTOGRAMS)
+      metrics.headerLatency = counters->headerLatency().read();
+      metrics.formatLatency = counters->formatLatency().read();
+#endif
+    }
+    return metrics;
   }
 
 private:
+  template <typename... Args>
+  void logAt(LogLevel level, std::format_string<Args...> fmt, Args &&...args) {
+    const details::EpochGuard guard;
+    const LoggerConfig &config = currentConfig();
+    if (!config.isEnabled(level))
+      return;
+    LogMetaData metaData{m_name, level};
+
+    // Skip formatting, if no outputter accepts the record. Every filter is
+    // evaluated exactly once.
+    auto it = config.m_outputters.begin();
+    while (it != config.m_outputters.end() && !it->accepts(metaData))
+      ++it;
+    if (it == config.m_outputters.end())
+      return;
+    LFY_PROBE(log_start, m_name.c_str(), static_cast<int>(level));
+
+    // Formatted in two stages, which are timed separately when built with
+    // LFY_LATENCY_HISTOGRAMS
+    details::Stopwatch stopwatch;
+    details::RecordBuffer buffer;
+    std::string &message = buffer.text();
+    config.m_formatter.appendHeaders<Args...>(
+        message, metaData, config.m_headerGenerators, fmt);
+    const std::size_t bodyOffset = message.size();
+    const std::uint64_t headersTime = stopwatch.lap();
+    config.m_formatter.formatBody(message, fmt, std::forward<Args>(args)...);
+    const std::uint64_t formatTime = stopwatch.lap();
+    LFY_PROBE(log_formatted, m_name.c_str(), message.size());
+    if (details::volumeProfiling.load(std::memory_order_relaxed))
+      VolumeProfiler::record(fmt.get(), this, m_name, message.size());
+    const LogRecord record{metaData, message, bodyOffset};
+    details::LoggerCounters &loggerCounters = counters();
+    loggerCounters.formatted(level, message.size());
+    loggerCounters.timed(headersTime, formatTime);
+
+    const bool durable = level >= config.m_durableLevel;
+    for (auto first = it; it != config.m_outputters.end(); ++it) {
+      if (it != first && !it->accepts(metaData))
+        continue;
+      const std::shared_ptr<Outputter> &outputter = it->m_outputter;
+      details::Stopwatch outputTime;
+      outputter->outputRecord(record);
+      outputter->countOutput(outputTime.lap());
+      if (durable)
+        outputter->sync();
+      else
+        config.m_flushApplier(outputter);
+    }
+    LFY_PROBE(log_done, m_name.c_str());
+  }
+
+  // Allocated by the first record, as many loggers never log themselves.
+  details::LoggerCounters &counters() {
+    details::LoggerCounters *counters =
+        m_counters.load(std::memory_order_acquire);
+    if (counters != nullptr)
+      return *counters;
+    auto created = std::make_unique<details::LoggerCounters>();
+    if (m_counters.compare_exchange_strong(counters, created.get(),
+                                           std::memory_order_acq_rel))
+      return *created.release();
+    return *counters;
+  }
+
+  // The hot path costs one relaxed load of the global generation, as long as
+  // no configuration changed. The result is valid as long as the caller holds
+  // a details::EpochGuard.
+  const LoggerConfig &currentConfig() const {
+    const std::uint64_t generation =
+        details::configGeneration.load(std::memory_order_relaxed);
+    // Acquire on both, as the configuration may have been replaced again
+    // after the generation was stored.
+    if (m_resolvedGeneration.load(std::memory_order_acquire) == generation)
+      return *m_config.load(std::memory_order_acquire);
+
+    // Acquire, so the settings of the change that bumped it are visible.
+    std::shared_lock l{details::config_mutex()};
+    return resolveConfigShared(
+        details::configGeneration.load(std::memory_order_acquire));
+  }
+
+  // Returns the effective configuration as of generation, or a later one.
+  // Loggers without own settings share the configuration of their parent (or
+  // the default one); the others rebuild theirs only if the own settings or
+  // the configuration of the parent changed since the last resolution. The
+  // replaced one is unreachable for calls of generation, so it is retired.
+  // Requires details::config_mutex shared, so the generation cannot change
+  // meanwhile and concurrent resolutions of a logger agree on the result.
+  // Loggers without own settings publish it with a CAS; rebuilds from own
+  // settings are serialized by details::resolve_mutex.
+  const LoggerConfig &resolveConfigShared(std::uint64_t generation) const {
+    if (m_resolvedGeneration.load(std::memory_order_acquire) >= generation)
+      return *m_config.load(std::memory_order_acquire);
+
+    const LoggerConfig *parentConfig =
+        m_parent != nullptr ? &m_parent->resolveConfigShared(generation)
+                            : nullptr;
+    const LoggerConfig &base =
+        parentConfig != nullptr ? *parentConfig : details::default_config();
+    if (m_settings == nullptr) {
+      const LoggerConfig *config = m_config.load(std::memory_order_relaxed);
+      // A failure means another thread published the same configuration
+      if (config != &base)
+        m_config.compare_exchange_strong(config, &base,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed);
+      m_resolvedGeneration.store(generation, std::memory_order_release);
+      return base;
+    }
+
+    std::lock_guard l{details::resolve_mutex(this)};
+    // Another thread might have been faster
+    if (m_resolvedGeneration.load(std::memory_order_relaxed) >= generation)
+      return *m_config.load(std::memory_order_relaxed);
+    if (m_settings->m_ownedConfig == nullptr ||
+        base.m_serial != m_settings->m_parentSerial) {
+      auto owned = std::make_unique<LoggerConfig>(base);
+      m_settings->applyTo(*owned);
+      owned->m_serial = details::next_config_serial();
+      details::retire(std::move(m_settings->m_ownedConfig));
+      m_settings->m_ownedConfig = std::move(owned);
+      m_settings->m_parentSerial = base.m_serial;
+    }
+    const LoggerConfig *config = m_settings->m_ownedConfig.get();
+    m_config.store(config, std::memory_order_release);
+    m_resolvedGeneration.store(generation, std::memory_order_release);
+    return *config;
+  }
+
+  // Own settings of a logger which diverged from its parent.
+  struct Settings : LoggerSettings {
+    // Resolution state. Changes of the settings reset the configuration.
+    std::unique_ptr<const LoggerConfig> m_ownedConfig;
+    std::uint64_t m_parentSerial{0};
+  };
+
+  // The configuration built from the previous settings is retired only after
+  // the generation changed, so no call which starts later can reach it.
+  template <typename Change> Logger &changeSettings(Change &&change) {
+    std::unique_ptr<const LoggerConfig> replaced;
+    {
+      std::lock_guard l{details::config_mutex()};
+      if (m_settings == nullptr)
+        m_settings = std::make_unique<Settings>();
+      change(*m_settings);
+      replaced = std::move(m_settings->m_ownedConfig);
+      details::configGeneration.fetch_add(1, std::memory_order_release);
+    }
+    details::retire(std::move(replaced));
+    details::reclaim_retired();
+    return *this;
+  }
+
+  // Replaces all own settings at once; empty settings make the logger follow
+  // its parent (or the defaults) again. Requires details::config_mutex, the
+  // caller increments the generation and then retires the returned
+  // configuration.
+  [[nodiscard]] std::unique_ptr<const LoggerConfig>
+  replaceSettingsUnlocked(LoggerSettings settings) {
+    std::unique_ptr<const LoggerConfig> replaced;
+    if (m_settings != nullptr)
+      replaced = std::move(m_settings->m_ownedConfig);
+    if (settings.empty()) {
+      m_settings = nullptr;
+      return replaced;
+    }
+    if (m_settings == nullptr)
+      m_settings = std::make_unique<Settings>();
+    static_cast<LoggerSettings &>(*m_settings) = std::move(settings);
+    return replaced;
+  }
+
+  // Called by the repository, when a closer ancestor got registered.
+  void setParent(std::shared_ptr<Logger> parent) {
+    std::unique_ptr<const LoggerConfig> replaced;
+    {
+      std::lock_guard l{details::config_mutex()};
+      m_parent = std::move(parent);
+      if (m_settings != nullptr)
+        replaced = std::move(m_settings->m_ownedConfig);
+      details::configGeneration.fetch_add(1, std::memory_order_release);
+    }
+    details::retire(std::move(replaced));
+    details::reclaim_retired();
+  }
+
+  [[nodiscard]] std::shared_ptr<Logger> getParent() const {
+    std::shared_lock l{details::config_mutex()};
+    return m_parent;
+  }
+
+  // Whether descendants may follow the logger: it was created as inheriting
+  // logger or has settings of its own.
+  [[nodiscard]] bool isInheriting() const {
+    if (m_inheriting)
+      return true;
+    std::shared_lock l{details::config_mutex()};
+    return m_settings != nullptr;
+  }
+
   Logger() = default;
   Logger(std::string name) : m_name{std::move(name)} {}
-  Logger(std::vector<std::shared_ptr<Outputter>> outputters,
-         std::vector<HeaderGenerator> headerGenerators, std::string name,
-         LogFormatter formatter, LogLevel logLevel, Flusher flusher)
-      : m_outputters(std::move(outputters)),
-        m_headerGenerators(std::move(headerGenerators)),
-        m_name(std::move(name)), m_formatter(std::move(formatter)),
-        m_level(logLevel), m_flushApplier(std::move(flusher)) {}
-
-  mutable std::mutex m_mutex;
-  std::vector<std::shared_ptr<Outputter>> m_outputters;
-  std::vector<HeaderGenerator> m_headerGenerators;
+  // Inheriting logger, which follows the settings of parent (if any) until
+  // it overrides them.
+  Logger(std::string name, std::shared_ptr<Logger> parent)
+      : m_name{std::move(name)}, m_inheriting{true},
+        m_parent{std::move(parent)} {}
 
   const std::string m_name;
-  LogFormatter m_formatter{};
-  std::atomic<LogLevel> m_level{LogLevel::Info};
-  Flusher m_flushApplier{flushers::Automatic()};
+  const bool m_inheriting{false};
+
+  // Guarded by details::config_mutex; the resolution state of m_settings by
+  // details::resolve_mutex as well
+  std::shared_ptr<Logger> m_parent;
+  mutable std::unique_ptr<Settings> m_settings; // Until diverged, nullptr
+
+  // Effective configuration, possibly shared with the parent. Written while
+  // holding details::config_mutex shared.
+  mutable std::atomic<const LoggerConfig *> m_config{nullptr};
+  mutable std::atomic<std::uint64_t> m_resolvedGeneration{0};
+
+  std::atomic<details::LoggerCounters *> m_counters{nullptr};
 };
 
-} // namespace lfy
\ No newline at end of file
+} // namespace lfy
@@ -0,0 +1,313 @@
+// Memory-mapped file outputter (Linux only).
+// The file is preallocated in large chunks and written through a sliding,
+// shared mapping. Producers reserve their byte range with a single fetch-add
+// and copy the message straight into the page cache. Only crossing a window
+// boundary takes the mutex and performs syscalls.
+//
+// While the outputter is open, the file ends with preallocated zero bytes.
+// It is trimmed to its logical length on destruction and on reopen.
+//
+// Offsets are reserved in a logical space which keeps growing across reopens;
+// each file starts at a window boundary of it. A record reserved just before
+// a reopen thus never lands in the new file's range. Producers reserve while
+// registered with a window, so draining it on reopen accounts for all records
+// of the replaced file, and the reopen waits for those still on their way.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "Outputter.hpp"
+#include "details/MappedFileLinux.hpp"
+
+namespace lfy {
+
+class MappedFileOutputter : public Outputter {
+public:
+  // windowSize is the size of the mapped region and must be a multiple of
+  // the page size; allocationChunk is the granularity of fallocate calls.
+  MappedFileOutputter(std::filesystem::path filePath,
+                      std::size_t windowSize = 16 * literals::MiB,
+                      std::size_t allocationChunk = 64 * literals::MiB)
+      : m_filePath{std::move(filePath)}, m_windowSize{windowSize},
+        m_allocationChunk{allocationChunk} {
+    if (m_windowSize == 0 || m_windowSize % details::page_size() != 0)
+      throw std::invalid_argument(
+          "MappedFileOutputter: window size must be a multiple of the page "
+          "size");
+    if (m_allocationChunk < m_windowSize)
+      m_allocationChunk = m_windowSize;
+
+    m_file = details::open_for_mapping(m_filePath);
+    if (!details::valid(m_file)) {
+      throw std::runtime_error(
+          "MappedFileOutputter: Failed to open file " + m_filePath.string() +
+          (std::filesystem::exists(m_filePath) ? " (Not enough access rights)"
+                                               : ""));
+    }
+
+    const std::uint64_t start = details::file_size(m_file);
+    m_allocated = start;
+    m_reserved.store(start, std::memory_order_relaxed);
+    mapWindowUnlocked(m_windows[0], start / m_windowSize);
+    m_current.store(&m_windows[0], std::memory_order_release);
+  }
+
+  ~MappedFileOutputter() override {
+    std::lock_guard l{m_mutex};
+    for (Window &window : m_windows)
+      details::unmap(window.base, m_windowSize);
+    // Drop the preallocated, never written tail.
+    try {
+      details::truncate_to(m_file, m_reserved.load(std::memory_order_relaxed) -
+                                       m_fileStart);
+    } catch (const std::runtime_error &) {
+    }
+    details::close_native(m_file);
+  }
+
+  void output(const std::string &message) override {
+    const std::size_t len = message.size() + 1;
+    Window *window = m_current.load(std::memory_order_acquire);
+    window->writers.fetch_add(1, std::memory_order_seq_cst);
+    if (!window->valid.load(std::memory_order_seq_cst)) {
+      window->writers.fetch_sub(1, std::memory_order_release);
+      std::lock_guard l{m_mutex};
+      writeUnlocked(m_reserved.fetch_add(len, std::memory_order_relaxed),
+                    message);
+      return;
+    }
+
+    const std::uint64_t offset =
+        m_reserved.fetch_add(len, std::memory_order_relaxed);
+    if (window->contains(offset, len)) {
+      copyInto(window->base + (offset - window->start), message);
+      window->writers.fetch_sub(1, std::memory_order_release);
+      countWrite(len);
+      return;
+    }
+    // Counted before leaving the window, for a reopen draining it.
+    m_slowWriters.fetch_add(1, std::memory_order_relaxed);
+    window->writers.fetch_sub(1, std::memory_order_release);
+
+    outputSlow(offset, message);
+  }
+
+  std::chrono::steady_clock::time_point lastFlush() override {
+    std::lock_guard l{m_mutex};
+    return m_lastFlush;
+  }
+
+  // Data is visible in the page cache as soon as output() returns. Writeback
+  // to the device is left to the kernel.
+  void flush() override {
+    std::lock_guard l{m_mutex};
+    m_lastFlush = std::chrono::steady_clock::now();
+  }
+
+  [[nodiscard]] std::string getName() const override {
+    return m_filePath.string();
+  }
+
+  // Records whose output() returned are in the page cache; write them back.
+  void sync() override {
+    m_groupCommit.commit([this] {
+      std::shared_lock f{m_fileMutex};
+      details::sync_data(m_file);
+    });
+  }
+
+  // Moves the window to the end of the file now at the path, after trimming
+  // the replaced file and draining the writers of its window. Without a
+  // rotation, the path still names the open file and nothing changes.
+  void reopen() override {
+    std::lock_guard r{m_reopenMutex};
+    std::unique_lock l{m_mutex};
+    details::NativeFile file = details::open_for_mapping(m_filePath);
+    if (!details::valid(file))
+      throw std::runtime_error("MappedFileOutputter: Failed to reopen file " +
+                               m_filePath.string());
+    if (details::same_file(file, m_file)) {
+      details::close_native(file);
+      return;
+    }
+    const std::uint64_t size = details::file_size(file);
+
+    // Everything reserved until here belongs to the replaced file. The new one
+    // starts past the current window, so no producer copies into that.
+    std::uint64_t end = m_reserved.load(std::memory_order_relaxed);
+    std::uint64_t start;
+    do {
+      start = (end / m_windowSize + 1) * m_windowSize;
+    } while (!m_reserved.compare_exchange_weak(end, start + size,
+                                               std::memory_order_relaxed));
+
+    // Producers still copying write below end, which the trim keeps.
+    try {
+      details::truncate_to(m_file, end - m_fileStart);
+    } catch (const std::runtime_error &) {
+    }
+    {
+      std::lock_guard f{m_fileMutex};
+      m_previousFile = m_file;
+      m_file = file;
+    }
+    m_previousStart = m_fileStart;
+    m_fileStart = start;
+    m_allocated = size;
+    advanceUnlocked((start + size) / m_windowSize);
+
+    // Records which left the drained window may still be for the old file.
+    m_slowDone.wait(l, [this] {
+      return m_slowWriters.load(std::memory_order_relaxed) == 0;
+    });
+    details::close_native(m_previousFile);
+  }
+
+private:
+  struct Window {
+    // Producers read the fields below only while they are registered as
+    // writer and the window is valid; they only change while it is invalid
+    // and drained.
+    std::atomic<bool> valid{false};
+    std::atomic<std::uint32_t> writers{0};
+    std::uint64_t start{0};
+    std::uint64_t end{0};
+    char *base{nullptr};
+
+    bool contains(std::uint64_t offset, std::size_t len) const {
+      return offset >= start && offset + len <= end;
+    }
+  };
+
+  static void copyInto(char *dst, const std::string &message) {
+    std::memcpy(dst, message.data(), message.size());
+    dst[message.size()] = '\n';
+  }
+
+  // Records which do not fit into the window they were reserved in.
+  void outputSlow(std::uint64_t offset, const std::string &message) {
+    {
+      std::lock_guard l{m_mutex};
+      writeUnlocked(offset, message);
+      m_slowWriters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    m_slowDone.notify_all();
+  }
+
+  // Either the window has to advance, or the record straddles a boundary or
+  // belongs to an already retired window or file and is written with pwrite
+  // instead.
+  void writeUnlocked(std::uint64_t offset, const std::string &message) {
+    const std::size_t len = message.size() + 1;
+    Window *current = m_current.load(std::memory_order_relaxed);
+    const std::uint64_t first = offset / m_windowSize;
+    const std::uint64_t last = (offset + len - 1) / m_windowSize;
+    if (!current->contains(offset, len) && first == last &&
+        first * m_windowSize > current->start)
+      current = advanceUnlocked(first);
+
+    if (current->contains(offset, len)) {
+      copyInto(current->base + (offset - current->start), message);
+      countWrite(len);
+      return;
+    }
+
+    // Offsets below the file's start were reserved before a reopen, which
+    // trimmed the replaced file past them.
+    const bool previous = offset < m_fileStart;
+    details::NativeFile &file = previous ? m_previousFile : m_file;
+    const std::uint64_t position =
+        offset - (previous ? m_previousStart : m_fileStart);
+    if (!previous)
+      ensureAllocatedUnlocked(position + len);
+    WriteStart start;
+    details::write_bytes_at(file, message.data(), message.size(), position);
+    details::write_bytes_at(file, "\n", 1, position + message.size());
+    countWrite(len, start);
+  }
+
+  Window *advanceUnlocked(std::uint64_t windowIndex) {
+    Window *old = m_current.load(std::memory_order_relaxed);
+    Window *next = (old == &m_windows[0]) ? &m_windows[1] : &m_windows[0];
+
+    mapWindowUnlocked(*next, windowIndex);
+    m_current.store(next, std::memory_order_release);
+
+    // Wait for producers still copying into the old window, then unmap it.
+    old->valid.store(false, std::memory_order_seq_cst);
+    while (old->writers.load(std::memory_order_seq_cst) != 0)
+      std::this_thread::yield();
+    details::unmap(old->base, m_windowSize);
+    old->base = nullptr;
+    old->start = old->end = 0;
+
+    m_lastFlush = std::chrono::steady_clock::now();
+    return next;
+  }
+
+  void mapWindowUnlocked(Window &window, std::uint64_t windowIndex) {
+    const std::uint64_t start = windowIndex * m_windowSize;
+    ensureAllocatedUnlocked(start - m_fileStart + m_windowSize);
+    window.base =
+        details::map_shared(m_file, start - m_fileStart, m_windowSize);
+    window.start = start;
+    window.end = start + m_windowSize;
+    window.valid.store(true, std::memory_order_release);
+  }
+
+  void ensureAllocatedUnlocked(std::uint64_t size) {
+    if (size <= m_allocated)
+      return;
+    const std::uint64_t target =
+        (size + m_allocationChunk - 1) / m_allocationChunk * m_allocationChunk;
+    details::preallocate(m_file, m_allocated, target - m_allocated);
+    m_allocated = target;
+  }
+
+  std::mutex m_mutex;
+  std::filesystem::path m_filePath;
+  details::NativeFile m_file;
+  std::uint64_t m_fileStart{0}; // Logical offset of the file's first byte
+  details::NativeFile m_previousFile{}; // Replaced file, during a reopen
+  std::uint64_t m_previousStart{0};
+  std::shared_mutex m_fileMutex; // Keeps reopen from closing m_file in a sync
+  std::mutex m_reopenMutex;      // Reopen releases m_mutex while it waits
+  std::atomic<std::uint32_t> m_slowWriters{0}; // Heading to outputSlow
+  std::condition_variable m_slowDone;
+  const std::size_t m_windowSize;
+  std::size_t m_allocationChunk;
+  std::uint64_t m_allocated{0}; // Preallocated file size
+
+  alignas(64) std::atomic<std::uint64_t> m_reserved{0}; // Logical end
+  alignas(64) std::atomic<Window *> m_current{nullptr};
+  std::array<Window, 2> m_windows;
+  details::GroupCommit m_groupCommit;
+
+  std::chrono::steady_clock::time_point m_lastFlush{
+      std::chrono::steady_clock::now()};
+};
+
+namespace outputters {
+
+template <typename... Args>
+inline auto MappedFile(std::filesystem::path filePath, Args &&...args) {
+  return std::make_shared<MappedFileOutputter>(std::move(filePath),
+                                               std::forward<Args>(args)...);
+}
+
+} // namespace outputters
+
+} // namespace lfy
@@ -0,0 +1,164 @@
+// Counters of the logging pipeline, per logger and per outputter.
+// Counters are sharded: each thread updates one cache line of its own (up to
+// details::metric_shards() threads, one per hardware thread), so counting
+// rarely contends between threads. Reading sums up all shards, hence a
+// snapshot is cheap to update but not to take.
+// Rates follow from the difference of two snapshots.
+// Built with LFY_LATENCY_HISTOGRAMS, loggers and outputters additionally keep
+// latency histograms of the pipeline stages (see Histogram.hpp).
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Histogram.hpp"
+#include "Types.hpp"
+
+namespace lfy {
+
+struct LoggerMetrics {
+  std::string name;
+  // Records logged, indexed by level
+  std::array<std::uint64_t, static_cast<std::size_t>(LogLevel::NumberOfLevels)>
+      messages{};
+  std::uint64_t bytesFormatted{0};
+#if defined(LFY_LATENCY_HISTOGRAMS)
+  LatencyHistogram::Snapshot headerLatency{}; // Header generation
+  LatencyHistogram::Snapshot formatLatency{}; // Formatting of the body
+#endif
+};
+
+struct OutputterMetrics {
+  std::string name;
+  std::uint64_t bytesWritten{0};  // Handed to the operating system
+  std::uint64_t writeSyscalls{0}; // Including retries of short writes
+  std::uint64_t flushes{0};       // Buffers handed to the operating system
+  std::uint64_t drops{0};         // Records which were not written
+#if defined(LFY_LATENCY_HISTOGRAMS)
+  // Calls of outputRecord by loggers, including lock waits and inline flushes
+  LatencyHistogram::Snapshot outputLatency{};
+  // Handing a buffer to the operating system, i.e. the write system calls
+  LatencyHistogram::Snapshot flushLatency{};
+#endif
+};
+
+struct MetricsSnapshot {
+  std::chrono::steady_clock::time_point time;
+  std::vector<LoggerMetrics> loggers;
+  std::vector<OutputterMetrics> outputters;
+};
+
+namespace details {
+
+// Bounds the memory of counters, which take a cache line per shard.
+inline constexpr std::size_t MaxMetricShards = 64;
+
+inline constexpr std::size_t LevelCount =
+    static_cast<std::size_t>(LogLevel::NumberOfLevels);
+
+// Number of shards: the hardware threads rounded up to a power of two, at
+// most MaxMetricShards.
+inline std::size_t metric_shards() {
+  static const std::size_t shards =
+      std::min(std::bit_ceil(std::max<std::size_t>(
+                   std::thread::hardware_concurrency(), 1)),
+               MaxMetricShards);
+  return shards;
+}
+
+// Shard of the calling thread. Threads get consecutive shards, so the first
+// metric_shards() threads never share one.
+inline std::size_t metric_shard() {
+  static std::atomic<std::size_t> next{0};
+  thread_local const std::size_t shard =
+      next.fetch_add(1, std::memory_order_relaxed) & (metric_shards() - 1);
+  return shard;
+}
+
+template <std::size_t K> class ShardedCounters {
+public:
+  void add(std::size_t counter, std::uint64_t value) {
+    m_shards[metric_shard()].values[counter].fetch_add(
+        value, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] std::array<std::uint64_t, K> read() const {
+    std::array<std::uint64_t, K> sums{};
+    for (std::size_t s = 0; s < metric_shards(); ++s)
+      for (std::size_t i = 0; i < K; ++i)
+        sums[i] += m_shards[s].values[i].load(std::memory_order_relaxed);
+    return sums;
+  }
+
+private:
+  struct alignas(64) Shard {
+    std::array<std::atomic<std::uint64_t>, K> values{};
+  };
+
+  std::unique_ptr<Shard[]> m_shards{new Shard[metric_shards()]};
+};
+
+// Messages per level, followed by the formatted bytes.
+class LoggerCounters : public ShardedCounters<LevelCount + 1> {
+public:
+  static constexpr std::size_t BytesFormatted = LevelCount;
+
+  void formatted(LogLevel level, std::size_t bytes) {
+    add(static_cast<std::size_t>(level), 1);
+    add(BytesFormatted, bytes);
+  }
+
+#if defined(LFY_LATENCY_HISTOGRAMS)
+  void timed(std::uint64_t headers, std::uint64_t format) {
+    m_headerLatency.record(headers);
+    m_formatLatency.record(format);
+  }
+
+  const LatencyHistogram &headerLatency() const { return m_headerLatency; }
+  const LatencyHistogram &formatLatency() const { return m_formatLatency; }
+
+private:
+  LatencyHistogram m_headerLatency;
+  LatencyHistogram m_formatLatency;
+#else
+  void timed(std::uint64_t, std::uint64_t) {}
+#endif
+};
+
+class OutputterCounters : public ShardedCounters<4> {
+public:
+  enum Counter : std::size_t { BytesWritten, WriteSyscalls, Flushes, Drops };
+
+#if defined(LFY_LATENCY_HISTOGRAMS)
+  void output(std::uint64_t nanoseconds) {
+    m_outputLatency.record(nanoseconds);
+  }
+  void flushed(std::uint64_t nanoseconds) {
+    m_flushLatency.record(nanoseconds);
+  }
+
+  const LatencyHistogram &outputLatency() const { return m_outputLatency; }
+  const LatencyHistogram &flushLatency() const { return m_flushLatency; }
+
+private:
+  LatencyHistogram m_outputLatency;
+  LatencyHistogram m_flushLatency;
+#else
+  void output(std::uint64_t) {}
+  void flushed(std::uint64_t) {}
+#endif
+};
+
+} // namespace details
+
+} // namespace lfy
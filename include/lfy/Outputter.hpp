@@ -6,15 +6,22 @@
 
 #include <array>
 #include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <filesystem>
 #include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
+#include "Metrics.hpp"
+#include "Types.hpp"
 #include "details/NativeFileHandleWrapper.hpp"
+#include "details/Probes.hpp"
 
 namespace lfy {
 
@@ -35,12 +42,197 @@ constexpr std::size_t GiB = 1_GiB;
 
 } // namespace literals
 
+// Incremental writeback for file outputters, to turn periodic dirty page
+// flush storms into a steady trickle. A threshold of zero disables the stage.
+struct WriteBehind {
+  // Start asynchronous writeback once this many bytes were written since the
+  // last writeback request (sync_file_range on Linux).
+  std::size_t syncBytes{0};
+  // Drop pages from the page cache once this many bytes are written back
+  // behind the last drop (posix_fadvise DONTNEED on Linux).
+  std::size_t dropBytes{0};
+};
+
+namespace details {
+
+// Tracks the written extent of an append-only file and issues writeback and
+// cache drop requests according to a WriteBehind policy. Not thread-safe.
+class WriteBehindTracker {
+public:
+  WriteBehindTracker() = default;
+  WriteBehindTracker(WriteBehind policy, std::uint64_t startOffset)
+      : m_policy{policy}, m_end{startOffset}, m_syncStarted{startOffset},
+        m_synced{startOffset}, m_dropped{startOffset} {}
+
+  // Continues with the same policy on another file.
+  void restart(std::uint64_t startOffset) {
+    *this = WriteBehindTracker{m_policy, startOffset};
+  }
+
+  void written(NativeFile &file, std::size_t len) {
+    m_end += len;
+
+    if (m_policy.syncBytes != 0 &&
+        m_end - m_syncStarted >= m_policy.syncBytes) {
+      // The previous range had a whole interval to complete, so waiting on
+      // it rarely blocks; it bounds the amount of dirty data in flight.
+      if (m_syncStarted > m_synced)
+        wait_writeback(file, m_synced, m_syncStarted - m_synced);
+      m_synced = m_syncStarted;
+      start_writeback(file, m_syncStarted, m_end - m_syncStarted);
+      m_syncStarted = m_end;
+    }
+
+    if (m_policy.dropBytes != 0) {
+      // Without explicit writeback, pages far enough behind the end are
+      // assumed to be written back by the kernel.
+      const std::uint64_t clean =
+          m_policy.syncBytes != 0
+              ? m_synced
+              : (m_end > m_policy.dropBytes ? m_end - m_policy.dropBytes : 0);
+      if (clean > m_dropped && clean - m_dropped >= m_policy.dropBytes) {
+        drop_cached(file, m_dropped, clean - m_dropped);
+        m_dropped = clean;
+      }
+    }
+  }
+
+private:
+  WriteBehind m_policy{};
+  std::uint64_t m_end{0};         // Bytes written
+  std::uint64_t m_syncStarted{0}; // Writeback requested up to here
+  std::uint64_t m_synced{0};      // Writeback completed up to here
+  std::uint64_t m_dropped{0};     // Cache dropped up to here
+};
+
+// Group commit: concurrent callers which need their writes on stable storage
+// share a single sync. The caller must have written its data before calling
+// commit(). The first caller becomes the leader and syncs on behalf of
+// everyone who arrived before the sync started; callers arriving during a
+// sync are covered by the next one.
+class GroupCommit {
+public:
+  // maxDelay bounds how long a leader waits for more callers to join its
+  // batch. Zero relies on natural batching while a sync is in progress.
+  void setMaxDelay(std::chrono::microseconds maxDelay) {
+    std::lock_guard l{m_mutex};
+    m_maxDelay = maxDelay;
+  }
+
+  template <typename SyncFn> void commit(SyncFn &&syncFn) {
+    std::unique_lock l{m_mutex};
+    const std::uint64_t ticket = ++m_requested;
+    m_done.wait(l, [&] { return m_completed >= ticket || !m_syncing; });
+    if (m_completed >= ticket)
+      return;
+
+    m_syncing = true;
+    if (m_maxDelay.count() > 0)
+      m_done.wait_for(l, m_maxDelay, [] { return false; });
+    const std::uint64_t covered = m_requested;
+
+    l.unlock();
+    try {
+      syncFn();
+    } catch (...) {
+      l.lock();
+      m_syncing = false;
+      m_done.notify_all();
+      throw;
+    }
+    l.lock();
+    m_completed = covered;
+    m_syncing = false;
+    m_done.notify_all();
+  }
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_done;
+  std::chrono::microseconds m_maxDelay{0};
+  std::uint64_t m_requested{0}; // Tickets handed out
+  std::uint64_t m_completed{0}; // Tickets covered by a finished sync
+  bool m_syncing{false};
+};
+
+} // namespace details
+
 class Outputter {
 public:
   virtual ~Outputter() = default;
   virtual void output(const std::string &message) = 0;
+  // Entry point used by loggers. Outputters which need more than the
+  // formatted message (e.g. the body or level) override this.
+  virtual void outputRecord(const LogRecord &record) {
+    output(record.m_message);
+  }
   virtual std::chrono::steady_clock::time_point lastFlush() = 0;
   virtual void flush() = 0;
+  // Flushes and makes all previously output messages durable. Outputters
+  // without stable storage only flush.
+  virtual void sync() { flush(); }
+  // Opens the output file again by its path, e.g. after log rotation moved
+  // it away. Buffered messages go to the old file first. Outputters without
+  // a file ignore it.
+  virtual void reopen() {}
+  // Identifies the outputter in metrics, e.g. by its file.
+  [[nodiscard]] virtual std::string getName() const { return "outputter"; }
+
+  [[nodiscard]] OutputterMetrics getMetrics() const {
+    using Counters = details::OutputterCounters;
+    const auto values = m_counters.read();
+    OutputterMetrics metrics{getName(), values[Counters::BytesWritten],
+                             values[Counters::WriteSyscalls],
+                             values[Counters::Flushes],
+                             values[Counters::Drops]};
+#if defined(LFY_LATENCY_HISTOGRAMS)
+    metrics.outputLatency = m_counters.outputLatency().read();
+    metrics.flushLatency = m_counters.flushLatency().read();
+#endif
+    return metrics;
+  }
+
+  // Called by loggers with the duration of outputRecord. A no-op unless
+  // built with LFY_LATENCY_HISTOGRAMS.
+  void countOutput(std::uint64_t nanoseconds) {
+    m_counters.output(nanoseconds);
+  }
+
+protected:
+  // Taken right before handing data to the operating system, to count the
+  // system calls and the time it takes.
+  struct WriteStart {
+    std::uint64_t syscalls{details::writeSyscalls};
+    details::Stopwatch stopwatch;
+  };
+
+  // Bookkeeping of implementations: bytes handed to the operating system
+  // since start, as one flush of buffered data or not. extraSyscalls counts
+  // calls made outside of details::write_bytes and friends.
+  void countWrite(std::size_t bytes, const WriteStart &start,
+                  std::uint64_t extraSyscalls = 0) {
+    m_counters.add(details::OutputterCounters::BytesWritten, bytes);
+    m_counters.add(details::OutputterCounters::WriteSyscalls,
+                   details::writeSyscalls - start.syscalls + extraSyscalls);
+  }
+
+  // Bytes which reach the operating system without a system call, e.g. by
+  // copying into a mapping.
+  void countWrite(std::size_t bytes) {
+    m_counters.add(details::OutputterCounters::BytesWritten, bytes);
+  }
+
+  void countFlush(std::size_t bytes, WriteStart &start,
+                  std::uint64_t extraSyscalls = 0) {
+    countWrite(bytes, start, extraSyscalls);
+    m_counters.add(details::OutputterCounters::Flushes, 1);
+    m_counters.flushed(start.stopwatch.lap());
+  }
+
+  void countDrop() { m_counters.add(details::OutputterCounters::Drops, 1); }
+
+private:
+  details::OutputterCounters m_counters;
 };
 
 // ConsoleOutputter is fully buffered and flushes standard output.
@@ -70,9 +262,11 @@ public:
     // Big messages which exceed the buffer size, are written directly to
     // avoid repeated flushes
     if (message.size() + 1 > m_buffer.capacity()) {
+      WriteStart start;
       std::fwrite(message.data(), 1, message.size(), stdout);
       std::fwrite("\n", 1, 1, stdout);
       std::fflush(stdout);
+      countFlush(message.size() + 1, start, 1);
       m_lastFlush = std::chrono::steady_clock::now();
       return;
     }
@@ -91,12 +285,19 @@ public:
     flushUnlocked();
   }
 
+  [[nodiscard]] std::string getName() const override { return "console"; }
+
 private:
+  // Counts one system call per flush, as stdout is written through stdio.
   void flushUnlocked() {
     if (m_buffer.empty())
       return;
+    LFY_PROBE(flush_start, this, m_buffer.size());
+    WriteStart start;
     std::fwrite(m_buffer.data(), 1, m_buffer.size(), stdout);
     std::fflush(stdout);
+    countFlush(m_buffer.size(), start, 1);
+    LFY_PROBE(flush_done, this, m_buffer.size());
     m_buffer.clear();
     m_lastFlush = std::chrono::steady_clock::now();
   }
@@ -107,43 +308,46 @@ private:
       std::chrono::steady_clock::now()};
 };
 
+// FileOutputter is double buffered: the producer which finds the active
+// buffer full swaps in the spare one under the lock and performs the write
+// outside of it. A writer token keeps at most one write in flight, so the file
+// preserves the order in which buffers were filled.
 template <size_t N> class FileOutputter : public Outputter {
 public:
-  FileOutputter(std::filesystem::path filePath)
+  FileOutputter(std::filesystem::path filePath, WriteBehind writeBehind = {})
       : m_filePath{std::move(filePath)} {
-    init();
+    init(writeBehind);
   }
 
   ~FileOutputter() override {
-    std::lock_guard l{m_mutex};
+    std::unique_lock l{m_mutex};
+    m_writerDone.wait(l, [this] { return !m_writing; });
     // Flush any remaining data in the buffer before destruction
-    if (m_bufferWriteIndex == 0)
-      return;
-    details::write_bytes(m_file, m_buffer.data(), m_bufferWriteIndex);
+    if (m_bufferWriteIndex != 0)
+      details::write_bytes(m_file, m_buffers[m_active].data(),
+                           m_bufferWriteIndex);
     details::close_native(m_file);
   }
-  void output(const std::string &message) override {
-    std::lock_guard l{m_mutex};
 
-    // If the buffer is full, flush it before adding new data
-    if ((m_bufferWriteIndex + message.size() + 1) > m_buffer.size())
-      flushUnlocked();
+  void output(const std::string &message) override {
+    std::unique_lock l{m_mutex};
 
     // Big messages which exceed the buffer size, are written directly to
     // avoid repeated flushes
-    // Todo possibly optimize away two fwrite calls
-    if (message.size() + 1 > m_buffer.size()) {
-      // Atomic append of message + newline without copying entire buffer on
-      // POSIX; Windows builds temp
-      details::write_line(m_file, message.data(), message.size());
-      m_lastFlush = std::chrono::steady_clock::now();
-      m_bufferWriteIndex = 0;
+    if (message.size() + 1 > N) {
+      writeOutsideLock(l, &message);
       return;
     }
 
-    std::memcpy(&m_buffer[m_bufferWriteIndex], message.data(), message.size());
+    // If the buffer is full, flush it before adding new data. Other producers
+    // may refill the buffer while the lock is released, hence the loop.
+    while ((m_bufferWriteIndex + message.size() + 1) > N)
+      flushUnlocked(l);
+
+    char *buffer = m_buffers[m_active].data();
+    std::memcpy(buffer + m_bufferWriteIndex, message.data(), message.size());
     m_bufferWriteIndex += message.size();
-    m_buffer[m_bufferWriteIndex++] = '\n';
+    buffer[m_bufferWriteIndex++] = '\n';
   }
 
   std::chrono::steady_clock::time_point lastFlush() override {
@@ -152,35 +356,129 @@ public:
   }
 
   void flush() override {
-    std::lock_guard l{m_mutex};
-    flushUnlocked();
+    std::unique_lock l{m_mutex};
+    flushUnlocked(l);
+  }
+
+  // A write in flight may carry records of the caller in the spare buffer,
+  // even if the active one is empty; it has to finish before the sync.
+  void sync() override {
+    {
+      std::unique_lock l{m_mutex};
+      flushUnlocked(l);
+      m_writerDone.wait(l, [this] { return !m_writing; });
+    }
+    m_groupCommit.commit([this] {
+      std::shared_lock f{m_fileMutex};
+      details::sync_data(m_file);
+    });
+  }
+
+  void reopen() override {
+    std::unique_lock l{m_mutex};
+    flushUnlocked(l);
+    m_writerDone.wait(l, [this] { return !m_writing; });
+    details::NativeFile file = openFile();
+    std::lock_guard f{m_fileMutex};
+    details::close_native(m_file);
+    m_file = file;
+    m_writeBehind.restart(details::file_size(m_file));
+  }
+
+  [[nodiscard]] std::string getName() const override {
+    return m_filePath.string();
+  }
+
+  // Bounds how long a sync waits for concurrent syncs to join its batch.
+  void setCommitDelay(std::chrono::microseconds delay) {
+    m_groupCommit.setMaxDelay(delay);
   }
 
 private:
-  void flushUnlocked() {
+  // Expects the lock to be held. Releases it for the duration of the write.
+  void flushUnlocked(std::unique_lock<std::mutex> &lock) {
     if (m_bufferWriteIndex == 0)
       return;
-    details::write_bytes(m_file, m_buffer.data(), m_bufferWriteIndex);
+    writeOutsideLock(lock, nullptr);
+  }
+
+  // Takes the writer token, swaps the active buffer for the spare one and
+  // writes the full buffer (followed by directMessage, if any) without
+  // holding the lock.
+  void writeOutsideLock(std::unique_lock<std::mutex> &lock,
+                        const std::string *directMessage) {
+    m_writerDone.wait(lock, [this] { return !m_writing; });
+    m_writing = true;
+
+    const std::array<char, N> &full = m_buffers[m_active];
+    const std::size_t fullSize = m_bufferWriteIndex;
+    m_active ^= 1;
     m_bufferWriteIndex = 0;
+
+    lock.unlock();
+    LFY_PROBE(flush_start, this, fullSize);
+    WriteStart start;
+    std::size_t written = fullSize;
+    try {
+      if (fullSize != 0) {
+        details::write_bytes(m_file, full.data(), fullSize);
+        m_writeBehind.written(m_file, fullSize);
+      }
+      // Atomic append of message + newline without copying entire buffer on
+      // POSIX; Windows builds temp
+      if (directMessage != nullptr) {
+        details::write_line(m_file, directMessage->data(),
+                            directMessage->size());
+        m_writeBehind.written(m_file, directMessage->size() + 1);
+        written += directMessage->size() + 1;
+      }
+      countFlush(written, start);
+    } catch (...) {
+      lock.lock();
+      releaseWriterToken();
+      throw;
+    }
+    LFY_PROBE(flush_done, this, written);
+    lock.lock();
     m_lastFlush = std::chrono::steady_clock::now();
+    releaseWriterToken();
   }
 
-  void init() {
-    m_file = details::open_for_append(m_filePath);
-    if (!details::valid(m_file)) {
+  void releaseWriterToken() {
+    m_writing = false;
+    m_writerDone.notify_all();
+  }
+
+  details::NativeFile openFile() const {
+    details::NativeFile file = details::open_for_append(m_filePath);
+    if (!details::valid(file)) {
       throw std::runtime_error(
           "FileOutputter: Failed to open file " + m_filePath.string() +
           (std::filesystem::exists(m_filePath) ? " (Not enough access rights)"
                                                : ""));
     }
+    return file;
+  }
+
+  void init(WriteBehind writeBehind) {
+    m_file = openFile();
+    if (writeBehind.syncBytes != 0 || writeBehind.dropBytes != 0)
+      m_writeBehind = details::WriteBehindTracker{
+          writeBehind, details::file_size(m_file)};
   }
 
   std::mutex m_mutex;
+  std::condition_variable m_writerDone;
   std::filesystem::path m_filePath;
   details::NativeFile m_file;
+  std::shared_mutex m_fileMutex; // Keeps reopen from closing m_file in a sync
 
-  std::array<char, N> m_buffer;      // Fixed-size buffer
+  std::array<std::array<char, N>, 2> m_buffers; // Active and spare buffer
+  unsigned m_active{0};              // Index of the buffer being filled
   std::size_t m_bufferWriteIndex{0}; // Current write index in the buffer
+  bool m_writing{false};             // Writer token, held during a write
+  details::WriteBehindTracker m_writeBehind; // Used by the token holder only
+  details::GroupCommit m_groupCommit;
 
   std::chrono::steady_clock::time_point m_lastFlush{
       std::chrono::steady_clock::now()};
@@ -217,13 +515,16 @@ template <typename... Args> inline auto Console(Args &&...args) {
   return std::make_shared<ConsoleOutputter>(std::forward<Args>(args)...);
 }
 
-inline auto File(std::filesystem::path filePath) {
-  return std::make_shared<FileOutputter<64 * literals::KiB>>(filePath);
+inline auto File(std::filesystem::path filePath,
+                 WriteBehind writeBehind = {}) {
+  return std::make_shared<FileOutputter<64 * literals::KiB>>(filePath,
+                                                             writeBehind);
 }
 
 template <typename... Args, std::size_t N>
-inline auto File(std::filesystem::path filePath, BufferCapacity<N>) {
-  return std::make_shared<FileOutputter<N>>(filePath);
+inline auto File(std::filesystem::path filePath, BufferCapacity<N>,
+                 WriteBehind writeBehind = {}) {
+  return std::make_shared<FileOutputter<N>>(filePath, writeBehind);
 }
 
 } // namespace outputters
@@ -0,0 +1,190 @@
+// Renders metrics in the Prometheus text exposition format (version 0.0.4),
+// e.g. to serve them from an existing HTTP endpoint:
+//
+//   std::string body = lfy::prometheus::render(lfy::Repository::getMetrics());
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Metrics.hpp"
+#include "Types.hpp"
+
+namespace lfy {
+
+namespace details {
+
+// Appends name="value" to a label set, which holds labels separated by commas.
+inline void append_prometheus_label(std::string &out, std::string_view name,
+                                    std::string_view value) {
+  if (!out.empty())
+    out.push_back(',');
+  out.append(name).append("=\"");
+  for (const char c : value) {
+    if (c == '\\' || c == '"') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (c == '\n') {
+      out.append("\\n");
+    } else {
+      out.push_back(c);
+    }
+  }
+  out.push_back('"');
+}
+
+inline void append_prometheus_header(std::string &out, std::string_view name,
+                                     std::string_view help,
+                                     std::string_view type = "counter") {
+  out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+  out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+inline void append_prometheus_sample(std::string &out, std::string_view name,
+                                     std::string_view labels,
+                                     std::uint64_t value) {
+  out.append(name).append("{").append(labels).append("} ");
+  out.append(std::to_string(value)).append("\n");
+}
+
+inline std::string prometheus_labels(std::string_view name,
+                                     std::string_view value) {
+  std::string labels;
+  append_prometheus_label(labels, name, value);
+  return labels;
+}
+
+// Label sets of the outputters. Outputters of the same name, e.g. two
+// consoles, are told apart by their position among them in label index.
+inline std::vector<std::string>
+prometheus_outputter_labels(const std::vector<OutputterMetrics> &outputters) {
+  std::unordered_map<std::string_view, std::size_t> named;
+  for (const OutputterMetrics &outputter : outputters)
+    ++named[outputter.name];
+  std::unordered_map<std::string_view, std::size_t> seen;
+  std::vector<std::string> labels;
+  for (const OutputterMetrics &outputter : outputters) {
+    labels.push_back(prometheus_labels("outputter", outputter.name));
+    if (named[outputter.name] > 1)
+      append_prometheus_label(labels.back(), "index",
+                              std::to_string(seen[outputter.name]++));
+  }
+  return labels;
+}
+
+#if defined(LFY_LATENCY_HISTOGRAMS)
+
+// Renders a histogram as summary in seconds, with the usual quantiles.
+inline void
+append_prometheus_summary(std::string &out, std::string_view name,
+                          std::string_view labels,
+                          const LatencyHistogram::Snapshot &latency) {
+  constexpr std::pair<double, std::string_view> Quantiles[] = {
+      {0.5, "0.5"}, {0.9, "0.9"}, {0.99, "0.99"}, {0.999, "0.999"}};
+  for (const auto &[quantile, label] : Quantiles) {
+    std::string quantileLabels{labels};
+    append_prometheus_label(quantileLabels, "quantile", label);
+    out.append(name).append("{").append(quantileLabels).append("} ");
+    out.append(std::to_string(latency.valueAt(quantile) / 1e9)).append("\n");
+  }
+  out.append(name).append("_sum{").append(labels).append("} ");
+  out.append(std::to_string(latency.sum / 1e9)).append("\n");
+  append_prometheus_sample(out, std::string(name) + "_count", labels,
+                           latency.count());
+}
+
+#endif
+
+} // namespace details
+
+namespace prometheus {
+
+inline std::string render(const MetricsSnapshot &snapshot) {
+  using details::append_prometheus_header;
+  using details::append_prometheus_label;
+  using details::append_prometheus_sample;
+  using details::prometheus_labels;
+  std::string out;
+
+  append_prometheus_header(out, "lfy_messages_total",
+                           "Records logged, by logger and level.");
+  for (const LoggerMetrics &logger : snapshot.loggers) {
+    for (std::size_t i = 0; i < logger.messages.size(); ++i) {
+      std::string labels = prometheus_labels("logger", logger.name);
+      append_prometheus_label(labels, "level",
+                              logLevelToString(static_cast<LogLevel>(i)));
+      append_prometheus_sample(out, "lfy_messages_total", labels,
+                               logger.messages[i]);
+    }
+  }
+
+  append_prometheus_header(out, "lfy_formatted_bytes_total",
+                           "Bytes of formatted records, by logger.");
+  for (const LoggerMetrics &logger : snapshot.loggers)
+    append_prometheus_sample(out, "lfy_formatted_bytes_total",
+                             prometheus_labels("logger", logger.name),
+                             logger.bytesFormatted);
+
+  const std::vector<std::string> outputterLabels =
+      details::prometheus_outputter_labels(snapshot.outputters);
+
+  struct Counter {
+    std::string_view name;
+    std::string_view help;
+    std::uint64_t OutputterMetrics::*value;
+  };
+  constexpr Counter OutputterCounters[] = {
+      {"lfy_written_bytes_total", "Bytes handed to the operating system.",
+       &OutputterMetrics::bytesWritten},
+      {"lfy_write_syscalls_total", "Write system calls.",
+       &OutputterMetrics::writeSyscalls},
+      {"lfy_flushes_total", "Buffers handed to the operating system.",
+       &OutputterMetrics::flushes},
+      {"lfy_drops_total", "Records which were not written.",
+       &OutputterMetrics::drops},
+  };
+  for (const Counter &counter : OutputterCounters) {
+    append_prometheus_header(out, counter.name, counter.help);
+    for (std::size_t i = 0; i < snapshot.outputters.size(); ++i)
+      append_prometheus_sample(out, counter.name, outputterLabels[i],
+                               snapshot.outputters[i].*counter.value);
+  }
+
+#if defined(LFY_LATENCY_HISTOGRAMS)
+  using details::append_prometheus_summary;
+  append_prometheus_header(out, "lfy_header_seconds",
+                           "Time spent generating headers.", "summary");
+  for (const LoggerMetrics &logger : snapshot.loggers)
+    append_prometheus_summary(out, "lfy_header_seconds",
+                              prometheus_labels("logger", logger.name),
+                              logger.headerLatency);
+  append_prometheus_header(out, "lfy_format_seconds",
+                           "Time spent formatting message bodies.", "summary");
+  for (const LoggerMetrics &logger : snapshot.loggers)
+    append_prometheus_summary(out, "lfy_format_seconds",
+                              prometheus_labels("logger", logger.name),
+                              logger.formatLatency);
+  append_prometheus_header(out, "lfy_output_seconds",
+                           "Time spent in outputters, including lock waits.",
+                           "summary");
+  for (std::size_t i = 0; i < snapshot.outputters.size(); ++i)
+    append_prometheus_summary(out, "lfy_output_seconds", outputterLabels[i],
+                              snapshot.outputters[i].outputLatency);
+  append_prometheus_header(out, "lfy_flush_seconds",
+                           "Time spent in write system calls.", "summary");
+  for (std::size_t i = 0; i < snapshot.outputters.size(); ++i)
+    append_prometheus_summary(out, "lfy_flush_seconds", outputterLabels[i],
+                              snapshot.outputters[i].flushLatency);
+#endif
+  return out;
+}
+
+} // namespace prometheus
+
+} // namespace lfy
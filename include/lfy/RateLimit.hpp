@@ -0,0 +1,141 @@
+// Per call site rate limiting and sampling of log statements.
+// Each LFY_* macro expansion owns a function-local static limiter, so the
+// state is scoped to the call site and checking it costs a few atomic ops.
+// Suppressed calls are counted and reported in a summary line, which is
+// logged right before the next admitted record of the same call site.
+//
+//   LFY_EVERY_N(logger, Warn, 100, "retrying {}", id);   // 1st, 101st, ...
+//   LFY_FIRST_N(logger, Info, 10, "slow path taken");      // 10 times, ever
+//   LFY_RATE_LIMITED(logger, Error, 5, "io error {}", ec); // 5 per second
+//
+// The logger expression is evaluated once, the arguments only if the call is
+// admitted.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "Logger.hpp"
+
+namespace lfy::ratelimit {
+
+// Outcome of an admission check.
+struct Admission {
+  bool admitted{false};
+  std::uint64_t suppressed{0}; // Calls suppressed since the last admission
+
+  explicit operator bool() const { return admitted; }
+};
+
+// Admits the first and then every n-th call.
+class EveryN {
+public:
+  explicit EveryN(std::uint64_t n) : m_n{n == 0 ? 1 : n} {}
+
+  Admission admit() {
+    const std::uint64_t call = m_calls.fetch_add(1, std::memory_order_relaxed);
+    if (call % m_n != 0)
+      return {};
+    return {true, call == 0 ? 0 : m_n - 1};
+  }
+
+private:
+  const std::uint64_t m_n;
+  std::atomic<std::uint64_t> m_calls{0};
+};
+
+// Admits the first n calls, then stays silent.
+class FirstN {
+public:
+  explicit FirstN(std::uint64_t n) : m_n{n} {}
+
+  Admission admit() {
+    // Avoid the read-modify-write once the site went silent.
+    if (m_calls.load(std::memory_order_relaxed) >= m_n)
+      return {};
+    return {m_calls.fetch_add(1, std::memory_order_relaxed) < m_n, 0};
+  }
+
+private:
+  const std::uint64_t m_n;
+  std::atomic<std::uint64_t> m_calls{0};
+};
+
+// Token bucket with a rate of perSecond and a burst of the same size,
+// implemented as generic cell rate algorithm: a single atomic holds the
+// theoretical arrival time of the next call. Rates are clamped to 1 to 10^9,
+// one token per nanosecond.
+class PerSecond {
+public:
+  explicit PerSecond(std::uint64_t perSecond)
+      : m_interval{NanosPerSecond / clamp(perSecond)},
+        m_burst{m_interval * clamp(perSecond)} {}
+
+  Admission admit() {
+    const std::int64_t now =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    std::int64_t tat = m_tat.load(std::memory_order_relaxed);
+    for (;;) {
+      const std::int64_t next = (tat > now ? tat : now) + m_interval;
+      if (next - now > m_burst) {
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return {};
+      }
+      if (m_tat.compare_exchange_weak(tat, next, std::memory_order_relaxed))
+        break;
+    }
+    // Skip the exchange, if nothing was suppressed.
+    if (m_suppressed.load(std::memory_order_relaxed) == 0)
+      return {true, 0};
+    return {true, m_suppressed.exchange(0, std::memory_order_relaxed)};
+  }
+
+private:
+  static constexpr std::int64_t NanosPerSecond =
+      std::chrono::nanoseconds(std::chrono::seconds(1)).count();
+
+  static std::int64_t clamp(std::uint64_t perSecond) {
+    return static_cast<std::int64_t>(std::clamp<std::uint64_t>(
+        perSecond, 1, static_cast<std::uint64_t>(NanosPerSecond)));
+  }
+
+  const std::int64_t m_interval; // Nanoseconds per token
+  const std::int64_t m_burst;    // Nanoseconds worth of tokens
+  std::atomic<std::int64_t> m_tat{0};
+  std::atomic<std::uint64_t> m_suppressed{0};
+};
+
+} // namespace lfy::ratelimit
+
+#define LFY_DETAIL_SITE_LIMITED(Limiter, limit, logger, level, ...)            \
+  do {                                                                         \
+    auto &&lfyLogger_ = (logger);                                              \
+    if (lfyLogger_->isEnabled(::lfy::LogLevel::level)) {                       \
+      static ::lfy::ratelimit::Limiter lfySite_{limit};                        \
+      if (const ::lfy::ratelimit::Admission lfyAdmission_ =                    \
+              lfySite_.admit()) {                                              \
+        if (lfyAdmission_.suppressed != 0)                                     \
+          lfyLogger_->log(::lfy::LogLevel::level,                              \
+                          "{} messages suppressed at {}:{}",                   \
+                          lfyAdmission_.suppressed, __FILE__, __LINE__);       \
+        lfyLogger_->log(::lfy::LogLevel::level, __VA_ARGS__);                  \
+      }                                                                        \
+    }                                                                          \
+  } while (false)
+
+// Logs the first and every n-th call of this call site.
+#define LFY_EVERY_N(logger, level, n, ...)                                     \
+  LFY_DETAIL_SITE_LIMITED(EveryN, n, logger, level, __VA_ARGS__)
+
+// Logs the first n calls of this call site.
+#define LFY_FIRST_N(logger, level, n, ...)                                     \
+  LFY_DETAIL_SITE_LIMITED(FirstN, n, logger, level, __VA_ARGS__)
+
+// Logs at most perSecond calls of this call site per second.
+#define LFY_RATE_LIMITED(logger, level, perSecond, ...)                        \
+  LFY_DETAIL_SITE_LIMITED(PerSecond, perSecond, logger, level, __VA_ARGS__)
@@ -4,57 +4,118 @@
 // for hierarchical loggers, which inherit properties from their parent loggers,
 // such as outputters and log levels. The levels are overwriteable, meaning that
 // a child logger can have a different log level than its parent.
+// Inheritance is live: later changes of a parent reach all its descendants,
+// unless they override the setting themselves.
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "Logger.hpp"
+#include "Metrics.hpp"
 #include "SegmentMap.hpp"
+#include "details/Epoch.hpp"
+#include "details/Hash.hpp"
 
 namespace lfy {
 
 namespace details {
 inline constexpr std::string DefaultLoggerName = "";
+
+// String literal usable as template argument.
+template <std::size_t N> struct FixedString {
+  consteval FixedString(const char (&str)[N]) { std::copy_n(str, N, m_data); }
+
+  constexpr std::string_view view() const { return {m_data, N - 1}; }
+
+  char m_data[N]{};
+};
 } // namespace details
 
 enum class Inheritance { Enabled, Disabled };
 
+// Non-owning handle to a logger of the repository. Loggers which were handed
+// out by the repository are kept alive until it is destroyed, even when they
+// get replaced or removed, so a LoggerRef never dangles and copying it costs
+// no reference count update.
+class LoggerRef {
+public:
+  LoggerRef() = default;
+  explicit LoggerRef(Logger *logger) : m_logger{logger} {}
+
+  Logger *operator->() const { return m_logger; }
+  Logger &operator*() const { return *m_logger; }
+  Logger *get() const { return m_logger; }
+  explicit operator bool() const { return m_logger != nullptr; }
+
+private:
+  Logger *m_logger{nullptr};
+};
+
 class Repository {
 public:
   // Retrieves a logger by its path. For inheritance, if no exact match is
   // found, it will search for the longest prefix match and create a new logger
-  // that inherits all settings from the parent logger, if any.
+  // that follows all settings of the parent logger, if any.
+  // Lookups of existing loggers do not lock, they search an immutable snapshot
+  // of the map, which writers replace as a whole.
   static std::shared_ptr<Logger>
   getLogger(const std::string &path,
             Inheritance inherit = Inheritance::Disabled) {
-    Singleton &self = getInstance();
-    std::lock_guard<std::mutex> lock(self.m_mutex);
-
-    // Try exact match first
-    if (auto logger = self.m_loggers.find(path); logger != nullptr) {
-      return logger;
+    {
+      details::EpochGuard guard;
+      if (const auto &logger = getInstance().snapshot().find(path);
+          logger != nullptr)
+        return logger;
     }
+    return createLogger(path, inherit);
+  }
 
-    // If there was no exact match and inheritance is requested,
-    // create a new logger by inheriting from the longest prefix match (if any)
-    if (inherit == Inheritance::Enabled) {
-      if (auto parentLogger = self.m_loggers.findByLongestPrefix(path);
-          parentLogger != nullptr) {
-        auto inheritedLogger = std::shared_ptr<Logger>(new Logger{
-            parentLogger->getOutputters(), parentLogger->getHeaderGenerators(),
-            path, parentLogger->getFormatter(), parentLogger->getLogLevel(),
-            parentLogger->getFlusher()});
-        self.m_loggers.insert(inheritedLogger);
-        return inheritedLogger;
-      }
+  // Like getLogger, but memoizes the result per thread. Once a thread has
+  // resolved a path, further calls neither touch shared state nor update a
+  // reference count, until the repository changes.
+  static LoggerRef getLoggerRef(std::string_view path,
+                                Inheritance inherit = Inheritance::Disabled) {
+    return getLoggerRef(path, details::fnv1a(path), inherit);
+  }
+
+  // Same as above with a precomputed details::fnv1a(path).
+  static LoggerRef getLoggerRef(std::string_view path, std::uint64_t hash,
+                                Inheritance inherit = Inheritance::Disabled) {
+    thread_local LoggerCache cache;
+    const std::uint64_t generation =
+        getInstance().m_generation.load(std::memory_order_acquire);
+    if (cache.generation != generation) {
+      cache.entries.clear();
+      cache.generation = generation;
     }
 
-    // Create a new logger if none found or inherited
-    auto newLogger = std::shared_ptr<Logger>(new Logger(path));
-    self.m_loggers.insert(newLogger);
-    return newLogger;
+    if (auto it = cache.entries.find(hash);
+        it != cache.entries.end() && it->second.path == path)
+      return LoggerRef{it->second.logger};
+
+    Logger *logger = nullptr;
+    {
+      details::EpochGuard guard;
+      logger = getInstance().snapshot().find(path).get();
+    }
+    // Retained by the repository, so the pointer stays valid
+    if (logger == nullptr)
+      logger = createLogger(std::string(path), inherit).get();
+    cache.entries.insert_or_assign(
+        hash, LoggerCache::Entry{std::string(path), logger});
+    return LoggerRef{logger};
   }
 
   static std::shared_ptr<Logger> getDefaultLogger() {
@@ -67,28 +128,194 @@ public:
     Singleton &self = getInstance();
     std::lock_guard<std::mutex> lock(self.m_mutex);
 
-    self.m_loggers.insert(logger);
+    const SegmentMap loggers = self.snapshot();
+    std::shared_ptr<Logger> displaced = loggers.find(logger->getName());
+    if (displaced == logger)
+      return;
+    self.publishUnlocked(SegmentMap(loggers).insert(logger),
+                         std::move(displaced));
+    adoptDescendants(loggers, logger);
   }
 
   // Removes a logger from the repository by its path.
   // The logger will not be publicly accessible anymore
-  void removeLogger(const std::string &path) {
+  static void removeLogger(const std::string &path) {
     Singleton &self = getInstance();
     std::lock_guard<std::mutex> lock(self.m_mutex);
 
-    self.m_loggers.remove(path);
+    SegmentMap loggers = self.snapshot();
+    std::shared_ptr<Logger> displaced = loggers.find(path);
+    if (displaced == nullptr)
+      return;
+    loggers.remove(path);
+    self.publishUnlocked(std::move(loggers), std::move(displaced));
+  }
+
+  // Calls fn for the logger of prefix, if any, and for all loggers below it.
+  // The empty prefix visits all loggers. Works on a snapshot, loggers added
+  // meanwhile may be missed.
+  template <typename Fn>
+  static void forEachLogger(std::string_view prefix, Fn &&fn) {
+    const SegmentMap loggers = getInstance().pinnedCopy();
+    if (const auto &logger = loggers.find(prefix); logger != nullptr)
+      fn(logger);
+    loggers.forEachDescendant(prefix, fn);
+  }
+
+  // Counters of all loggers and of the outputters attached to them.
+  static MetricsSnapshot getMetrics() {
+    MetricsSnapshot snapshot{std::chrono::steady_clock::now(), {}, {}};
+    std::unordered_set<const Outputter *> seen;
+    forEachLogger("", [&](const std::shared_ptr<Logger> &logger) {
+      snapshot.loggers.push_back(logger->getMetrics());
+      for (const auto &outputter : logger->getOutputters())
+        if (seen.insert(outputter.get()).second)
+          snapshot.outputters.push_back(outputter->getMetrics());
+    });
+    return snapshot;
+  }
+
+  // Replaces the settings of several inheriting loggers, creating them as
+  // needed. Loggers switch to the new settings all at once: no record is
+  // logged with a mix of old and new settings. Empty settings make a logger
+  // follow its parent again.
+  // Returns once the replaced configurations are destroyed, i.e. once the
+  // logging calls which started before finished; outputters which are not
+  // attached anymore are released by then.
+  static void
+  configure(std::vector<std::pair<std::string, LoggerSettings>> settings) {
+    std::vector<std::shared_ptr<Logger>> loggers;
+    loggers.reserve(settings.size());
+    for (const auto &[path, _] : settings)
+      loggers.push_back(getLogger(path, Inheritance::Enabled));
+
+    std::vector<std::unique_ptr<const LoggerConfig>> replaced;
+    {
+      std::lock_guard l{details::config_mutex()};
+      for (std::size_t i = 0; i < loggers.size(); ++i)
+        replaced.push_back(
+            loggers[i]->replaceSettingsUnlocked(std::move(settings[i].second)));
+      details::configGeneration.fetch_add(1, std::memory_order_release);
+    }
+    for (auto &config : replaced)
+      details::retire(std::move(config));
+    details::reclaim_retired();
+
+    // Descendants with settings of their own built their configurations from
+    // the replaced ones; resolving retires those as well.
+    {
+      const details::EpochGuard guard;
+      forEachLogger("", [](const std::shared_ptr<Logger> &logger) {
+        logger->currentConfig();
+      });
+    }
+    details::synchronize_retired();
   }
 
 private:
   Repository() = default;
+
+  static std::shared_ptr<Logger> createLogger(const std::string &path,
+                                              Inheritance inherit) {
+    Singleton &self = getInstance();
+    std::lock_guard<std::mutex> lock(self.m_mutex);
+    // Only writers replace the map, a copy of the root suffices
+    const SegmentMap loggers = self.snapshot();
+
+    // Try exact match first, another thread might have created it meanwhile
+    if (const auto &logger = loggers.find(path); logger != nullptr) {
+      return logger;
+    }
+
+    // If there was no exact match and inheritance is requested,
+    // create a new logger by inheriting from the longest prefix match (if any)
+    std::shared_ptr<Logger> newLogger;
+    if (inherit == Inheritance::Enabled)
+      newLogger.reset(new Logger{path, loggers.findByLongestPrefix(path)});
+    else
+      newLogger.reset(new Logger(path));
+    self.publishUnlocked(SegmentMap(loggers).insert(newLogger));
+    adoptDescendants(loggers, newLogger);
+    return newLogger;
+  }
+
+  // Inheriting loggers follow their closest registered ancestor which takes
+  // part in inheritance, i.e. was created as inheriting logger or has
+  // settings. Descendants of such a newly registered logger, which followed
+  // an ancestor above it (or a logger it replaced) or had none, follow it
+  // from now on. A plain logger leaves them alone.
+  static void adoptDescendants(const SegmentMap &loggers,
+                               const std::shared_ptr<Logger> &logger) {
+    if (!logger->isInheriting())
+      return;
+    const std::string &name = logger->getName();
+    loggers.forEachDescendant(
+        name, [&logger, &name](const std::shared_ptr<Logger> &descendant) {
+          if (!descendant->m_inheriting)
+            return;
+          const std::shared_ptr<Logger> parent = descendant->getParent();
+          if (parent == nullptr ||
+              (parent != logger && parent->getName().size() <= name.size()))
+            descendant->setParent(logger);
+        });
+  }
   virtual ~Repository() = default;
 
+  struct LoggerCache {
+    struct Entry {
+      std::string path;
+      Logger *logger;
+    };
+
+    std::uint64_t generation{0};
+    std::unordered_map<std::uint64_t, Entry> entries;
+  };
+
   struct Singleton {
     Singleton() = default;
     Singleton(const Singleton &) = delete;
     Singleton &operator=(const Singleton &) = delete;
-    std::mutex m_mutex;
-    SegmentMap m_loggers;
+    ~Singleton() { delete m_loggers.load(std::memory_order_relaxed); }
+
+    // Valid as long as the caller holds a details::EpochGuard or m_mutex.
+    const SegmentMap &snapshot() const {
+      return *m_loggers.load(std::memory_order_acquire);
+    }
+
+    // A copy shares the nodes of the snapshot and stays valid without a
+    // guard.
+    SegmentMap pinnedCopy() const {
+      details::EpochGuard guard;
+      return snapshot();
+    }
+
+    // Replaces the snapshot; the previous one is destroyed once no lookup
+    // uses it anymore. The logger which the change displaced (if any) is
+    // retained, as there might be LoggerRefs to it.
+    void publishUnlocked(SegmentMap loggers,
+                         std::shared_ptr<Logger> displaced = nullptr) {
+      if (displaced != nullptr)
+        m_retired.push_back(std::move(displaced));
+      std::unique_ptr<const SegmentMap> replaced{m_loggers.exchange(
+          new SegmentMap(std::move(loggers)), std::memory_order_acq_rel)};
+      m_generation.fetch_add(1, std::memory_order_release);
+      // Reclaimed right away, so snapshots do not pile up while loggers are
+      // created
+      details::retire(std::move(replaced));
+      details::reclaim_retired();
+    }
+
+    std::mutex m_mutex; // Serializes writers
+    std::atomic<const SegmentMap *> m_loggers{new SegmentMap()};
+    // Loggers displaced by addLogger and removeLogger. LoggerRefs and the
+    // handles of lfy::logger may still point to them, so they are kept until
+    // exit: one logger, with its settings, per call which displaced one.
+    // Replacing loggers is meant for setup, not for a steady stream of
+    // changes.
+    std::vector<std::shared_ptr<Logger>> m_retired;
+    // Incremented on every change, invalidates the per-thread caches.
+    // Starts at 1, so a fresh cache is always invalid.
+    std::atomic<std::uint64_t> m_generation{1};
   };
 
   static Singleton &getInstance() {
@@ -97,4 +324,20 @@ private:
   }
 };
 
-} // namespace lfy
\ No newline at end of file
+// Returns the logger with the literal name, e.g. lfy::logger<"net.http">().
+// The name is hashed at compile time and resolved once per instantiation;
+// afterwards a call only loads the cached handle. Later replacements of the
+// logger (addLogger, removeLogger) are not observed by the handle.
+template <details::FixedString Name,
+          Inheritance Inherit = Inheritance::Disabled>
+LoggerRef logger() {
+  static constexpr std::uint64_t Hash = details::fnv1a(Name.view());
+  static const LoggerRef cached =
+      Repository::getLoggerRef(Name.view(), Hash, Inherit);
+  return cached;
+}
+
+} // namespace lfy
+
+// Shorthand for lfy::logger<name>().
+#define LFY_LOGGER(name) ::lfy::logger<name>()
@@ -1,11 +1,30 @@
 #pragma once
 
 #include "Logger.hpp"
+#include "details/Hash.hpp"
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <string_view>
-#include <unordered_map>
+#include <vector>
 
 namespace lfy {
 
+// Maps logger names to loggers. A logger name is segmented by a delimiter
+// (e.g., '.'), which identifies parent-child relationships: for each two
+// logger names a,b , where a is a full prefix (from start to delimiter) of b,
+// a is considered the parent of b. E.g. "app.module" is parent of
+// "app.module.submodule". All keys share the default logger "" as their
+// ultimate parent.
+//
+// The map is a trie with one node per segment, so exact and longest prefix
+// lookups are a single walk from the root, hashing each segment once. Nodes
+// are immutable and shared between copies: modifications copy the path from
+// the root to the changed node only, so copying a map is O(1) and a copy is
+// never affected by changes to the original. The children of a node are kept
+// in a hash array mapped trie, so nodes with many thousands of children are
+// copied in small pieces as well.
 class SegmentMap {
 public:
   SegmentMap() = default;
@@ -13,56 +32,338 @@ public:
   // Inserts a logger into the map. Replaces any existing logger with the same
   // name.
   SegmentMap &insert(std::shared_ptr<Logger> logger) {
-    std::string_view key = logger->getName();
-    m_map.insert_or_assign(std::move(key), std::move(logger));
+    // The name is owned by the logger, which outlives the call.
+    const std::string_view name = logger->getName();
+    m_root = assign(m_root.get(), {}, name, 0, std::move(logger));
     return *this;
   }
 
-  // Exact match find
-  std::shared_ptr<Logger> find(std::string_view key) const {
-    auto it = m_map.find(key);
-    return (it != m_map.end()) ? it->second : nullptr;
+  // Exact match find. The result refers into the map, or to a null pointer.
+  const std::shared_ptr<Logger> &find(std::string_view key) const {
+    const Node *node = walk(key);
+    return node != nullptr ? node->m_logger : none();
   }
 
   // Finds the logger by the longest matching segment prefix.
   // E.g., if the map contains loggers for "app", "app.module",
   // and the key is "app.module.submodule", it will return the logger for
-  // "app.module".
-  std::shared_ptr<Logger> findByLongestPrefix(std::string_view key) const {
-    // Direct match first
-    if (auto val = find(key); val)
-      return val;
+  // "app.module". Falls back to the default logger, if it exists.
+  const std::shared_ptr<Logger> &
+  findByLongestPrefix(std::string_view key) const {
+    const Node *node = m_root.get();
+    if (node == nullptr)
+      return none();
 
-    // If no direct match, search for the longest prefix
-    for (auto i = key.size() - 1; i > 0; --i) {
-      if (key[i] != m_delimiter)
-        continue;
-
-      std::string_view substr = key.substr(0, i);
-      auto it = m_map.find(substr);
-      if (it != m_map.end())
-        return it->second;
+    const std::shared_ptr<Logger> *best = &node->m_logger;
+    for (std::size_t pos = 0; !isEnd(key, pos);) {
+      const std::size_t end = segmentEnd(key, pos);
+      node = node->child(key.substr(pos, end - pos));
+      if (node == nullptr)
+        break;
+      if (node->m_logger != nullptr)
+        best = &node->m_logger;
+      pos = end + 1;
     }
+    return *best;
+  }
 
-    // If no prefix match, return the default logger if it exists
-    if (auto defaultLoggerIt = m_map.find(""); defaultLoggerIt != end(m_map))
-      return defaultLoggerIt->second;
+  void remove(std::string_view key) {
+    if (m_root != nullptr)
+      m_root = erase(m_root, key, 0);
+  }
 
-    return nullptr;
+  template <typename Fn> void forEach(Fn &&fn) const {
+    if (m_root != nullptr)
+      visit(*m_root, fn);
   }
 
-  void remove(std::string_view key) { m_map.erase(key); }
+  // Calls fn for the loggers below key, excluding the one of key itself.
+  template <typename Fn>
+  void forEachDescendant(std::string_view key, Fn &&fn) const {
+    if (const Node *node = walk(key); node != nullptr)
+      node->m_children.forEach([&fn](const Node &child) { visit(child, fn); });
+  }
 
 private:
-  // Idea: Each logger contains a name, so we can use that as the key. To be
-  // extra memory efficient. A logger name can be segmented by a delimiter
-  // (e.g., '.'), which can be used to identify parent-child relationships.
-  // For each two logger names a,b , where a is a full prefix (from start to
-  // delimiter) of b, we can consider a as the parent of b.
-  // e.g. "app.module" is parent of "app.module.submodule".
-  // All keys share the default logger as their ultimate parent.
-  std::unordered_map<std::string_view, std::shared_ptr<Logger>> m_map;
-  const char m_delimiter = '.';
+  struct Node;
+  using NodePtr = std::shared_ptr<const Node>;
+
+  // Persistent hash array mapped trie of child nodes, keyed by segment. Each
+  // level consumes 5 bits of the segment hash and holds up to 32 entries;
+  // segments whose hashes collide in all levels share a bucket.
+  class Children {
+  public:
+    // Returns the owning pointer of the child of segment, if any.
+    const NodePtr *find(std::string_view segment) const {
+      const std::uint64_t hash = details::fnv1a(segment);
+      const Table *table = m_table.get();
+      for (unsigned shift = 0; table != nullptr; shift += Bits) {
+        if (shift >= MaxShift)
+          return findInBucket(*table, segment);
+        const std::uint32_t bit = bitFor(hash, shift);
+        if ((table->m_bitmap & bit) == 0)
+          return nullptr;
+        const Entry &entry = table->m_entries[indexOf(*table, bit)];
+        if (entry.m_node != nullptr)
+          return entry.m_node->m_segment == segment ? &entry.m_node : nullptr;
+        table = entry.m_table.get();
+      }
+      return nullptr;
+    }
+
+    // Returns a copy which contains child, replacing the child of the same
+    // segment.
+    [[nodiscard]] Children with(NodePtr child) const {
+      const std::uint64_t hash = details::fnv1a(child->m_segment);
+      return wrap(insert(m_table.get(), std::move(child), hash, 0));
+    }
+
+    // Returns a copy without the child of segment.
+    [[nodiscard]] Children without(std::string_view segment) const {
+      if (m_table == nullptr)
+        return *this;
+      return wrap(erase(m_table, segment, details::fnv1a(segment), 0));
+    }
+
+    [[nodiscard]] bool empty() const { return m_table == nullptr; }
+
+    template <typename Fn> void forEach(Fn &&fn) const {
+      if (m_table != nullptr)
+        visitTable(*m_table, fn);
+    }
+
+  private:
+    struct Table;
+    using TablePtr = std::shared_ptr<const Table>;
+
+    // Either a child node or a nested table.
+    struct Entry {
+      NodePtr m_node;
+      TablePtr m_table;
+    };
+
+    struct Table {
+      std::uint32_t m_bitmap{0}; // Unused in collision buckets
+      std::vector<Entry> m_entries;
+    };
+
+    static constexpr unsigned Bits = 5;
+    static constexpr unsigned MaxShift = 60;
+
+    static Children wrap(TablePtr table) {
+      Children children;
+      children.m_table = std::move(table);
+      return children;
+    }
+
+    static std::uint32_t bitFor(std::uint64_t hash, unsigned shift) {
+      return std::uint32_t{1} << ((hash >> shift) & ((1u << Bits) - 1));
+    }
+
+    static std::size_t indexOf(const Table &table, std::uint32_t bit) {
+      return static_cast<std::size_t>(
+          std::popcount(table.m_bitmap & (bit - 1)));
+    }
+
+    static const NodePtr *findInBucket(const Table &bucket,
+                                       std::string_view segment) {
+      for (const Entry &entry : bucket.m_entries)
+        if (entry.m_node->m_segment == segment)
+          return &entry.m_node;
+      return nullptr;
+    }
+
+    static TablePtr insert(const Table *table, NodePtr child,
+                           std::uint64_t hash, unsigned shift) {
+      auto copy = table != nullptr ? std::make_shared<Table>(*table)
+                                   : std::make_shared<Table>();
+      if (shift >= MaxShift) {
+        for (Entry &entry : copy->m_entries) {
+          if (entry.m_node->m_segment == child->m_segment) {
+            entry.m_node = std::move(child);
+            return copy;
+          }
+        }
+        copy->m_entries.push_back(Entry{std::move(child), nullptr});
+        return copy;
+      }
+
+      const std::uint32_t bit = bitFor(hash, shift);
+      const std::size_t index = indexOf(*copy, bit);
+      if ((copy->m_bitmap & bit) == 0) {
+        copy->m_bitmap |= bit;
+        copy->m_entries.insert(copy->m_entries.begin() + index,
+                               Entry{std::move(child), nullptr});
+        return copy;
+      }
+
+      Entry &entry = copy->m_entries[index];
+      if (entry.m_table != nullptr) {
+        entry.m_table =
+            insert(entry.m_table.get(), std::move(child), hash, shift + Bits);
+      } else if (entry.m_node->m_segment == child->m_segment) {
+        entry.m_node = std::move(child);
+      } else {
+        // Push both nodes one level down.
+        NodePtr existing = std::move(entry.m_node);
+        const std::uint64_t existingHash = details::fnv1a(existing->m_segment);
+        TablePtr nested =
+            insert(nullptr, std::move(existing), existingHash, shift + Bits);
+        entry.m_table =
+            insert(nested.get(), std::move(child), hash, shift + Bits);
+      }
+      return copy;
+    }
+
+    // Returns table itself, if segment does not exist, or nullptr if the
+    // table became empty.
+    static TablePtr erase(const TablePtr &table, std::string_view segment,
+                          std::uint64_t hash, unsigned shift) {
+      std::size_t index = 0;
+      if (shift >= MaxShift) {
+        while (index < table->m_entries.size() &&
+               table->m_entries[index].m_node->m_segment != segment)
+          ++index;
+        if (index == table->m_entries.size())
+          return table;
+      } else {
+        const std::uint32_t bit = bitFor(hash, shift);
+        if ((table->m_bitmap & bit) == 0)
+          return table;
+        index = indexOf(*table, bit);
+      }
+
+      const Entry &entry = table->m_entries[index];
+      TablePtr nested;
+      if (entry.m_table != nullptr) {
+        nested = erase(entry.m_table, segment, hash, shift + Bits);
+        if (nested == entry.m_table)
+          return table;
+      } else if (entry.m_node->m_segment != segment) {
+        return table;
+      }
+
+      auto copy = std::make_shared<Table>(*table);
+      if (nested != nullptr) {
+        copy->m_entries[index].m_table = std::move(nested);
+        return copy;
+      }
+      copy->m_entries.erase(copy->m_entries.begin() + index);
+      if (shift < MaxShift)
+        copy->m_bitmap &= ~bitFor(hash, shift);
+      if (copy->m_entries.empty())
+        return nullptr;
+      return copy;
+    }
+
+    template <typename Fn> static void visitTable(const Table &table, Fn &fn) {
+      for (const Entry &entry : table.m_entries) {
+        if (entry.m_node != nullptr)
+          fn(*entry.m_node);
+        else
+          visitTable(*entry.m_table, fn);
+      }
+    }
+
+    TablePtr m_table;
+  };
+
+  struct Node {
+    const Node *child(std::string_view segment) const {
+      const NodePtr *child = m_children.find(segment);
+      return child != nullptr ? child->get() : nullptr;
+    }
+
+    std::string m_segment;
+    std::shared_ptr<Logger> m_logger;
+    Children m_children;
+  };
+
+  static constexpr char Delimiter = '.';
+
+  static const std::shared_ptr<Logger> &none() {
+    static const std::shared_ptr<Logger> empty;
+    return empty;
+  }
+
+  // Whether all segments of key before pos have been consumed. The empty key
+  // has no segments, "a." has the segments "a" and "".
+  static bool isEnd(std::string_view key, std::size_t pos) {
+    return key.empty() || pos > key.size();
+  }
+
+  static std::size_t segmentEnd(std::string_view key, std::size_t pos) {
+    const std::size_t end = key.find(Delimiter, pos);
+    return end == std::string_view::npos ? key.size() : end;
+  }
+
+  // Returns the node of key, if any.
+  const Node *walk(std::string_view key) const {
+    const Node *node = m_root.get();
+    for (std::size_t pos = 0; node != nullptr && !isEnd(key, pos);) {
+      const std::size_t end = segmentEnd(key, pos);
+      node = node->child(key.substr(pos, end - pos));
+      pos = end + 1;
+    }
+    return node;
+  }
+
+  // Returns a copy of node (or a new node named segment) where the remaining
+  // key, starting at pos, maps to logger.
+  static NodePtr assign(const Node *node, std::string_view segment,
+                        std::string_view key, std::size_t pos,
+                        std::shared_ptr<Logger> logger) {
+    auto copy = node != nullptr ? std::make_shared<Node>(*node)
+                                : std::make_shared<Node>(Node{
+                                      std::string(segment), nullptr, {}});
+    if (isEnd(key, pos)) {
+      copy->m_logger = std::move(logger);
+      return copy;
+    }
+
+    const std::size_t end = segmentEnd(key, pos);
+    const std::string_view next = key.substr(pos, end - pos);
+    copy->m_children = copy->m_children.with(
+        assign(copy->child(next), next, key, end + 1, std::move(logger)));
+    return copy;
+  }
+
+  // Returns a copy of node without the logger of the remaining key, or
+  // nullptr if the node became empty. Returns node itself, if the key does
+  // not exist.
+  static NodePtr erase(const NodePtr &node, std::string_view key,
+                       std::size_t pos) {
+    std::shared_ptr<Node> copy;
+    if (isEnd(key, pos)) {
+      copy = std::make_shared<Node>(*node);
+      copy->m_logger = nullptr;
+    } else {
+      const std::size_t end = segmentEnd(key, pos);
+      const std::string_view segment = key.substr(pos, end - pos);
+      const NodePtr *child = node->m_children.find(segment);
+      if (child == nullptr)
+        return node;
+
+      NodePtr erased = erase(*child, key, end + 1);
+      if (erased == *child)
+        return node;
+      copy = std::make_shared<Node>(*node);
+      copy->m_children = erased == nullptr
+                             ? copy->m_children.without(segment)
+                             : copy->m_children.with(std::move(erased));
+    }
+    if (copy->m_logger == nullptr && copy->m_children.empty())
+      return nullptr;
+    return copy;
+  }
+
+  template <typename Fn> static void visit(const Node &node, Fn &fn) {
+    if (node.m_logger != nullptr)
+      fn(node.m_logger);
+    node.m_children.forEach([&fn](const Node &child) { visit(child, fn); });
+  }
+
+  NodePtr m_root;
 };
 
-} // namespace lfy
\ No newline at end of file
+} // namespace lfy
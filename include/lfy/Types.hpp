@@ -4,7 +4,9 @@
 
 #include <array>
 #include <chrono>
+#include <cstddef>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <thread>
 
@@ -29,6 +31,18 @@ struct LogMetaData {
   const std::optional<std::thread::id> m_threadId{std::this_thread::get_id()};
 };
 
+// A formatted log message together with the data it was created from.
+struct LogRecord {
+  // Message body without the headers
+  std::string_view body() const {
+    return std::string_view{m_message}.substr(m_bodyOffset);
+  }
+
+  const LogMetaData &m_metaData;
+  const std::string &m_message;
+  const std::size_t m_bodyOffset;
+};
+
 constexpr std::string_view logLevelToString(LogLevel level) {
   constexpr static std::array logLevelMap = {"DEBUG", "INFO", "WARN", "ERROR"};
   static_assert(logLevelMap.size() ==
@@ -37,4 +51,24 @@ constexpr std::string_view logLevelToString(LogLevel level) {
   return logLevelMap[static_cast<size_t>(level)];
 }
 
-} // namespace lfy
\ No newline at end of file
+// Inverse of logLevelToString, case insensitive.
+constexpr std::optional<LogLevel> logLevelFromString(std::string_view name) {
+  constexpr auto Count = static_cast<std::size_t>(LogLevel::NumberOfLevels);
+  for (std::size_t i = 0; i < Count; ++i) {
+    const std::string_view candidate =
+        logLevelToString(static_cast<LogLevel>(i));
+    if (candidate.size() != name.size())
+      continue;
+    bool equal = true;
+    for (std::size_t j = 0; j < name.size() && equal; ++j) {
+      const char c = name[j];
+      equal = (c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c) ==
+              candidate[j];
+    }
+    if (equal)
+      return static_cast<LogLevel>(i);
+  }
+  return std::nullopt;
+}
+
+} // namespace lfy
@@ -0,0 +1,263 @@
+// Double-buffered file outputter which submits full buffers through io_uring
+// (Linux only). While one buffer is in flight, producers keep filling the
+// other one; the thread that fills a buffer only pays for the submission, not
+// for the write itself. Buffers and the file are registered with the ring.
+//
+// Kernels without io_uring (or where it is disabled) fall back to the
+// synchronous write_bytes path of FileOutputter.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+
+#include "Outputter.hpp"
+#include "details/MappedFileLinux.hpp"
+#include "details/UringLinux.hpp"
+
+namespace lfy {
+
+template <std::size_t N> class UringFileOutputter : public Outputter {
+public:
+  UringFileOutputter(std::filesystem::path filePath)
+      : m_filePath{std::move(filePath)} {
+    init();
+  }
+
+  ~UringFileOutputter() override {
+    std::lock_guard l{m_mutex};
+    try {
+      submitUnlocked();
+      drainUnlocked();
+    } catch (const std::runtime_error &) {
+      // Nothing sensible to report from a destructor.
+    }
+    m_ring.close();
+    details::close_native(m_file);
+  }
+
+  void output(const std::string &message) override {
+    std::lock_guard l{m_mutex};
+
+    if (m_writeIndex + message.size() + 1 > N)
+      submitUnlocked();
+
+    // Big messages which exceed the buffer size, are written directly. Wait
+    // for in-flight buffers first, so the file keeps the logging order.
+    if (message.size() + 1 > N) {
+      WriteStart start;
+      if (m_useRing) {
+        drainUnlocked();
+        details::write_bytes_at(m_file, message.data(), message.size(),
+                                m_fileOffset);
+        details::write_bytes_at(m_file, "\n", 1,
+                                m_fileOffset + message.size());
+        m_fileOffset += message.size() + 1;
+      } else {
+        details::write_line(m_file, message.data(), message.size());
+      }
+      countFlush(message.size() + 1, start);
+      m_lastFlush = std::chrono::steady_clock::now();
+      return;
+    }
+
+    char *buffer = m_buffers[m_active].data();
+    std::memcpy(buffer + m_writeIndex, message.data(), message.size());
+    m_writeIndex += message.size();
+    buffer[m_writeIndex++] = '\n';
+  }
+
+  std::chrono::steady_clock::time_point lastFlush() override {
+    std::lock_guard l{m_mutex};
+    return m_lastFlush;
+  }
+
+  // Submits the current buffer without waiting for its completion.
+  void flush() override {
+    std::lock_guard l{m_mutex};
+    submitUnlocked();
+  }
+
+  void sync() override {
+    {
+      std::lock_guard l{m_mutex};
+      submitUnlocked();
+      drainUnlocked();
+    }
+    m_groupCommit.commit([this] {
+      std::shared_lock f{m_fileMutex};
+      details::sync_data(m_file);
+    });
+  }
+
+  [[nodiscard]] std::string getName() const override {
+    return m_filePath.string();
+  }
+
+  // Sets up the ring again, as the file is registered with it.
+  void reopen() override {
+    std::lock_guard l{m_mutex};
+    submitUnlocked();
+    drainUnlocked();
+    // Fail before tearing anything down, if the path cannot be opened.
+    details::NativeFile probe = details::open_for_append(m_filePath);
+    if (!details::valid(probe))
+      throw std::runtime_error("UringFileOutputter: Failed to reopen file " +
+                               m_filePath.string());
+    details::close_native(probe);
+
+    std::lock_guard f{m_fileMutex};
+    m_ring.close();
+    details::close_native(m_file);
+    init();
+  }
+
+  [[nodiscard]] bool usesIoUring() const { return m_useRing; }
+
+private:
+  static constexpr unsigned BufferCount = 2;
+
+  void init() {
+    m_useRing = setupRing();
+    m_file = m_useRing ? details::open_for_mapping(m_filePath)
+                       : details::open_for_append(m_filePath);
+    if (!details::valid(m_file)) {
+      throw std::runtime_error(
+          "UringFileOutputter: Failed to open file " + m_filePath.string() +
+          (std::filesystem::exists(m_filePath) ? " (Not enough access rights)"
+                                               : ""));
+    }
+    if (m_useRing && !m_ring.registerFiles(&m_file.fd, 1)) {
+      m_ring.close();
+      details::close_native(m_file);
+      m_useRing = false;
+      m_file = details::open_for_append(m_filePath);
+    }
+    if (m_useRing)
+      m_fileOffset = details::file_size(m_file);
+  }
+
+  bool setupRing() {
+    if (!m_ring.setup(BufferCount * 2))
+      return false;
+    std::array<iovec, BufferCount> vecs{};
+    for (unsigned i = 0; i < BufferCount; ++i)
+      vecs[i] = {m_buffers[i].data(), N};
+    // Registration pins memory and may exceed RLIMIT_MEMLOCK.
+    if (!m_ring.registerBuffers(vecs.data(), BufferCount)) {
+      m_ring.close();
+      return false;
+    }
+    return true;
+  }
+
+  // Hands the active buffer to the kernel and switches to the other one.
+  void submitUnlocked() {
+    if (m_writeIndex == 0)
+      return;
+
+    WriteStart start;
+    std::uint64_t enters = 0; // io_uring_enter calls of the submission
+    if (!m_useRing) {
+      details::write_bytes(m_file, m_buffers[m_active].data(), m_writeIndex);
+    } else {
+      // The next buffer may still be in flight from the previous submission.
+      const unsigned next = (m_active + 1) % BufferCount;
+      while (m_inFlight[next] != 0)
+        reapUnlocked(true);
+
+      m_inFlight[m_active] = m_writeIndex;
+      m_inFlightOffset[m_active] = m_fileOffset;
+      if (m_ring.submitWriteFixed(m_buffers[m_active].data(), m_writeIndex,
+                                  m_fileOffset, m_active, m_active)) {
+        enters = 1;
+      } else {
+        m_inFlight[m_active] = 0;
+        details::write_bytes_at(m_file, m_buffers[m_active].data(),
+                                m_writeIndex, m_fileOffset);
+      }
+      m_fileOffset += m_writeIndex;
+      m_active = next;
+
+      // Collect completions which are already there, without blocking.
+      while (reapUnlocked(false))
+        ;
+    }
+    countFlush(m_writeIndex, start, enters);
+    m_writeIndex = 0;
+    m_lastFlush = std::chrono::steady_clock::now();
+  }
+
+  void drainUnlocked() {
+    for (unsigned i = 0; i < BufferCount; ++i)
+      while (m_inFlight[i] != 0)
+        reapUnlocked(true);
+  }
+
+  // Consumes one completion. Short writes are completed synchronously.
+  bool reapUnlocked(bool wait) {
+    details::UringCompletion completion{};
+    const bool got = wait ? m_ring.waitCompletion(completion)
+                          : m_ring.peekCompletion(completion);
+    if (!got) {
+      if (wait)
+        throw std::runtime_error("UringFileOutputter: io_uring_enter failed");
+      return false;
+    }
+
+    const auto index = static_cast<unsigned>(completion.userData);
+    const std::size_t len = m_inFlight[index];
+    m_inFlight[index] = 0;
+    if (completion.result < 0)
+      throw std::runtime_error("UringFileOutputter: write failed");
+
+    const auto written = static_cast<std::size_t>(completion.result);
+    if (written < len)
+      details::write_bytes_at(m_file, m_buffers[index].data() + written,
+                              len - written,
+                              m_inFlightOffset[index] + written);
+    return true;
+  }
+
+  std::mutex m_mutex;
+  std::filesystem::path m_filePath;
+  details::NativeFile m_file;
+  std::shared_mutex m_fileMutex; // Keeps reopen from closing m_file in a sync
+  details::Uring m_ring;
+  bool m_useRing{false};
+
+  std::array<std::array<char, N>, BufferCount> m_buffers;
+  unsigned m_active{0};          // Buffer producers currently fill
+  std::size_t m_writeIndex{0};   // Current write index in the active buffer
+  std::uint64_t m_fileOffset{0}; // File offset of the next submission
+  std::array<std::size_t, BufferCount> m_inFlight{};         // Bytes or 0
+  std::array<std::uint64_t, BufferCount> m_inFlightOffset{}; // File offsets
+  details::GroupCommit m_groupCommit;
+
+  std::chrono::steady_clock::time_point m_lastFlush{
+      std::chrono::steady_clock::now()};
+};
+
+namespace outputters {
+
+inline auto UringFile(std::filesystem::path filePath) {
+  return std::make_shared<UringFileOutputter<64 * literals::KiB>>(
+      std::move(filePath));
+}
+
+template <std::size_t N>
+inline auto UringFile(std::filesystem::path filePath, BufferCapacity<N>) {
+  return std::make_shared<UringFileOutputter<N>>(std::move(filePath));
+}
+
+} // namespace outputters
+
+} // namespace lfy
@@ -0,0 +1,347 @@
+// Finds the call sites which produce most of the log volume, without
+// analysing the logs: while profiling, loggers count the records and bytes of
+// each call site, identified by the address of its format string and by the
+// logger.
+//
+//   lfy::VolumeProfiler::start();
+//   ...
+//   for (const lfy::VolumeSite &site : lfy::VolumeProfiler::report(5).sites)
+//     std::cout << site.bytes << " " << site.logger << " " << site.format;
+//
+// Memory is bounded: each of the details::metric_shards() shards keeps a
+// Space-Saving summary of a fixed number of sites. Heavy hitters are always
+// kept; a rare site may be evicted in favour of a newer one, which then
+// inherits the evicted counts as error. Without profiling, the cost of a
+// record is one relaxed load.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Metrics.hpp"
+
+namespace lfy {
+
+struct VolumeSite {
+  std::string logger;
+  std::string_view format; // Format string of the call site
+  // Estimates which exceed the true values by at most error bytes and the
+  // according number of records.
+  std::uint64_t count{0};
+  std::uint64_t bytes{0};
+  std::uint64_t error{0};
+};
+
+struct VolumeReport {
+  std::chrono::steady_clock::duration elapsed{}; // Since start or reset
+  std::uint64_t totalCount{0};                   // Exact
+  std::uint64_t totalBytes{0};                   // Exact
+  std::vector<VolumeSite> sites;                 // Heaviest first
+};
+
+namespace details {
+
+inline std::atomic<bool> volumeProfiling{false};
+
+// Space-Saving summary (Metwally et al.) of call sites weighted by bytes.
+// Sites are found through a linear probing index; the lightest site, which
+// gets replaced when a new site finds the summary full, is on top of a binary
+// min-heap of the sites by bytes.
+class SpaceSaving {
+public:
+  struct Entry {
+    std::string_view format;
+    const void *logger{nullptr};
+    std::string loggerName;
+    std::uint64_t count{0};
+    std::uint64_t bytes{0};
+    std::uint64_t error{0};
+  };
+
+  explicit SpaceSaving(std::size_t capacity)
+      : m_capacity{std::max<std::size_t>(capacity, 1)},
+        m_index(std::bit_ceil(m_capacity * 2), Empty) {
+    m_entries.reserve(m_capacity);
+    m_heap.reserve(m_capacity);
+    m_heapPos.reserve(m_capacity);
+  }
+
+  void add(std::string_view format, const void *logger,
+           const std::string &loggerName, std::uint64_t bytes) {
+    std::size_t slot = find(format.data(), logger);
+    if (m_index[slot] != Empty) {
+      Entry &entry = m_entries[m_index[slot]];
+      ++entry.count;
+      entry.bytes += bytes;
+      siftDown(m_heapPos[m_index[slot]]);
+      return;
+    }
+
+    std::uint32_t i;
+    if (m_entries.size() < m_capacity) {
+      i = static_cast<std::uint32_t>(m_entries.size());
+      m_entries.emplace_back();
+      m_heapPos.push_back(static_cast<std::uint32_t>(m_heap.size()));
+      m_heap.push_back(i);
+    } else {
+      i = m_heap.front();
+      Entry &victim = m_entries[i];
+      erase(find(victim.format.data(), victim.logger));
+      slot = find(format.data(), logger);
+      victim.error = victim.bytes;
+    }
+    Entry &entry = m_entries[i];
+    entry.format = format;
+    entry.logger = logger;
+    entry.loggerName = loggerName;
+    ++entry.count;
+    entry.bytes += bytes;
+    m_index[slot] = i;
+    // An added site starts at the bottom of the heap and may be lighter than
+    // its parent; a replaced one was the lightest and only grew.
+    siftUp(m_heapPos[i]);
+    siftDown(m_heapPos[i]);
+  }
+
+  [[nodiscard]] bool full() const { return m_entries.size() == m_capacity; }
+
+  // Bytes of the lightest site, which bounds the bytes of any evicted site.
+  [[nodiscard]] std::uint64_t minimum() const {
+    return full() ? m_entries[m_heap.front()].bytes : 0;
+  }
+
+  [[nodiscard]] const std::vector<Entry> &entries() const { return m_entries; }
+
+private:
+  static constexpr std::uint32_t Empty = ~std::uint32_t{0};
+
+  std::size_t home(const char *format, const void *logger) const {
+    std::uint64_t hash =
+        reinterpret_cast<std::uintptr_t>(format) * 0x9e3779b97f4a7c15ull ^
+        reinterpret_cast<std::uintptr_t>(logger) * 0xc2b2ae3d27d4eb4full;
+    hash ^= hash >> 29;
+    return static_cast<std::size_t>(hash) & (m_index.size() - 1);
+  }
+
+  // Slot of the site, or the empty slot where it belongs.
+  std::size_t find(const char *format, const void *logger) const {
+    const std::size_t mask = m_index.size() - 1;
+    std::size_t slot = home(format, logger);
+    while (m_index[slot] != Empty) {
+      const Entry &entry = m_entries[m_index[slot]];
+      if (entry.format.data() == format && entry.logger == logger)
+        return slot;
+      slot = (slot + 1) & mask;
+    }
+    return slot;
+  }
+
+  // Empties the slot and moves later sites of its probe sequence forward.
+  void erase(std::size_t hole) {
+    const std::size_t mask = m_index.size() - 1;
+    for (std::size_t next = (hole + 1) & mask; m_index[next] != Empty;
+         next = (next + 1) & mask) {
+      const Entry &entry = m_entries[m_index[next]];
+      const std::size_t slot = home(entry.format.data(), entry.logger);
+      if (((next - slot) & mask) >= ((next - hole) & mask)) {
+        m_index[hole] = m_index[next];
+        hole = next;
+      }
+    }
+    m_index[hole] = Empty;
+  }
+
+  bool lighter(std::size_t a, std::size_t b) const {
+    return m_entries[m_heap[a]].bytes < m_entries[m_heap[b]].bytes;
+  }
+
+  void swapHeap(std::size_t a, std::size_t b) {
+    std::swap(m_heap[a], m_heap[b]);
+    m_heapPos[m_heap[a]] = static_cast<std::uint32_t>(a);
+    m_heapPos[m_heap[b]] = static_cast<std::uint32_t>(b);
+  }
+
+  void siftUp(std::size_t pos) {
+    while (pos != 0 && lighter(pos, (pos - 1) / 2)) {
+      swapHeap(pos, (pos - 1) / 2);
+      pos = (pos - 1) / 2;
+    }
+  }
+
+  // Sites only grow, so they only move down.
+  void siftDown(std::size_t pos) {
+    for (;;) {
+      std::size_t lightest = pos;
+      for (const std::size_t child : {2 * pos + 1, 2 * pos + 2})
+        if (child < m_heap.size() && lighter(child, lightest))
+          lightest = child;
+      if (lightest == pos)
+        return;
+      swapHeap(pos, lightest);
+      pos = lightest;
+    }
+  }
+
+  std::size_t m_capacity;
+  std::vector<std::uint32_t> m_index;
+  std::vector<Entry> m_entries;
+  std::vector<std::uint32_t> m_heap;    // Entries, lightest first
+  std::vector<std::uint32_t> m_heapPos; // Position of each entry in m_heap
+};
+
+} // namespace details
+
+class VolumeProfiler {
+public:
+  static constexpr std::size_t DefaultCapacity = 128;
+  // Bounds the memory of a profile, which takes about 100 bytes per site and
+  // shard.
+  static constexpr std::size_t MaxCapacity = 4096;
+
+  // Starts profiling from scratch, tracking up to capacity sites per shard
+  // (at most MaxCapacity).
+  static void start(std::size_t capacity = DefaultCapacity) {
+    Singleton &self = getInstance();
+    std::lock_guard l{self.m_mutex};
+    self.m_capacity = std::min(capacity, MaxCapacity);
+    resetUnlocked(self);
+    details::volumeProfiling.store(true, std::memory_order_relaxed);
+  }
+
+  // Stops counting; the report stays available until the next start.
+  static void stop() {
+    Singleton &self = getInstance();
+    std::lock_guard l{self.m_mutex};
+    if (details::volumeProfiling.exchange(false, std::memory_order_relaxed))
+      self.m_elapsed = std::chrono::steady_clock::now() - self.m_started;
+  }
+
+  static bool running() {
+    return details::volumeProfiling.load(std::memory_order_relaxed);
+  }
+
+  // Discards all counts, keeps profiling if it runs.
+  static void reset() {
+    Singleton &self = getInstance();
+    std::lock_guard l{self.m_mutex};
+    resetUnlocked(self);
+  }
+
+  // The n heaviest sites by bytes. Sites of all shards are merged; a site
+  // missing in a full shard may have been evicted there, which adds the
+  // minimum of that shard to its error.
+  [[nodiscard]] static VolumeReport report(std::size_t n) {
+    Singleton &self = getInstance();
+    std::lock_guard l{self.m_mutex};
+    VolumeReport report;
+    report.elapsed = running()
+                         ? std::chrono::steady_clock::now() - self.m_started
+                         : self.m_elapsed;
+
+    struct Merged {
+      VolumeSite site;
+      std::uint64_t shards{0}; // Bit set of the shards which know the site
+    };
+    std::map<std::pair<const char *, const void *>, Merged> merged;
+    std::array<std::uint64_t, details::MaxMetricShards> minimums{};
+    for (std::size_t s = 0; s < details::metric_shards(); ++s) {
+      Shard &shard = self.m_shards[s];
+      std::lock_guard sl{shard.mutex};
+      report.totalCount += shard.count;
+      report.totalBytes += shard.bytes;
+      if (!shard.summary)
+        continue;
+      minimums[s] = shard.summary->minimum();
+      for (const auto &entry : shard.summary->entries()) {
+        Merged &m = merged[{entry.format.data(), entry.logger}];
+        if (m.shards == 0)
+          m.site = {entry.loggerName, entry.format, 0, 0, 0};
+        m.site.count += entry.count;
+        m.site.bytes += entry.bytes;
+        m.site.error += entry.error;
+        m.shards |= std::uint64_t{1} << s;
+      }
+    }
+
+    for (auto &[key, m] : merged) {
+      for (std::size_t s = 0; s < details::metric_shards(); ++s) {
+        if ((m.shards & (std::uint64_t{1} << s)) == 0) {
+          m.site.bytes += minimums[s];
+          m.site.error += minimums[s];
+        }
+      }
+      report.sites.push_back(std::move(m.site));
+    }
+    const std::size_t count = std::min(n, report.sites.size());
+    std::partial_sort(report.sites.begin(), report.sites.begin() + count,
+                      report.sites.end(),
+                      [](const VolumeSite &a, const VolumeSite &b) {
+                        return a.bytes > b.bytes;
+                      });
+    report.sites.resize(count);
+    return report;
+  }
+
+  // Called by loggers for each formatted record, while profiling.
+  static void record(std::string_view format, const void *logger,
+                     const std::string &loggerName, std::size_t bytes) {
+    Shard &shard = getInstance().m_shards[details::metric_shard()];
+    std::lock_guard l{shard.mutex};
+    if (!shard.summary)
+      return;
+    shard.summary->add(format, logger, loggerName, bytes);
+    ++shard.count;
+    shard.bytes += bytes;
+  }
+
+private:
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    std::optional<details::SpaceSaving> summary;
+    std::uint64_t count{0};
+    std::uint64_t bytes{0};
+  };
+
+  struct Singleton {
+    std::mutex m_mutex; // Serializes start, stop, reset and report
+    std::size_t m_capacity{DefaultCapacity};
+    std::chrono::steady_clock::time_point m_started{};
+    std::chrono::steady_clock::duration m_elapsed{};
+    std::unique_ptr<Shard[]> m_shards{new Shard[details::metric_shards()]};
+  };
+  static_assert(details::MaxMetricShards <= 64,
+                "report() keeps the shards of a site in 64 bits");
+
+  static void resetUnlocked(Singleton &self) {
+    for (std::size_t s = 0; s < details::metric_shards(); ++s) {
+      Shard &shard = self.m_shards[s];
+      std::lock_guard l{shard.mutex};
+      shard.summary.emplace(self.m_capacity);
+      shard.count = 0;
+      shard.bytes = 0;
+    }
+    self.m_started = std::chrono::steady_clock::now();
+    self.m_elapsed = {};
+  }
+
+  static Singleton &getInstance() {
+    static Singleton instance;
+    return instance;
+  }
+};
+
+} // namespace lfy
@@ -0,0 +1,315 @@
+// Block compression used by the compressed file outputter (header-only).
+// Every block is framed by a small header and can be decoded on its own, so a
+// truncated file only loses the block that was being written.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(LFY_HAS_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace lfy::details {
+
+enum class BlockCodec : std::uint8_t { Stored = 0, Lz4 = 1, Zlib = 2 };
+
+// Frame header in front of each payload. On disk, it takes Size bytes in the
+// order of the members, integers in little endian, so files can be read on
+// hosts of either byte order.
+struct BlockHeader {
+  static constexpr std::uint32_t Magic = 0x5a59464c; // "LFYZ"
+  static constexpr std::size_t Size = 16;
+
+  std::uint32_t magic{Magic};
+  BlockCodec codec{BlockCodec::Stored};
+  std::uint32_t rawSize{0};
+  std::uint32_t payloadSize{0};
+};
+
+inline void store_le32(char *p, std::uint32_t v) {
+  for (int i = 0; i < 4; ++i)
+    p[i] = static_cast<char>((v >> (8 * i)) & 0xff);
+}
+
+inline std::uint32_t load_le32(const char *p) {
+  std::uint32_t v = 0;
+  for (int i = 0; i < 4; ++i)
+    v |= static_cast<std::uint32_t>(static_cast<unsigned char>(p[i]))
+         << (8 * i);
+  return v;
+}
+
+inline void encode_header(const BlockHeader &header, char *p) {
+  store_le32(p, header.magic);
+  p[4] = static_cast<char>(header.codec);
+  p[5] = p[6] = p[7] = 0; // Reserved
+  store_le32(p + 8, header.rawSize);
+  store_le32(p + 12, header.payloadSize);
+}
+
+inline BlockHeader decode_header(const char *p) {
+  BlockHeader header;
+  header.magic = load_le32(p);
+  header.codec = static_cast<BlockCodec>(static_cast<unsigned char>(p[4]));
+  header.rawSize = load_le32(p + 8);
+  header.payloadSize = load_le32(p + 12);
+  return header;
+}
+
+// LZ4 block format: sequences of [token][literals][offset][match length].
+// Compatible with the reference decoder, tuned for speed over ratio.
+namespace lz4 {
+
+inline constexpr std::size_t MinMatch = 4;
+inline constexpr std::size_t LastLiterals = 5;
+inline constexpr std::size_t MatchFindLimit = 12;
+inline constexpr std::size_t MaxOffset = 65535;
+inline constexpr unsigned HashLog = 12;
+
+inline constexpr std::size_t compress_bound(std::size_t n) {
+  return n + n / 255 + 16;
+}
+
+inline std::uint32_t read32(const char *p) {
+  std::uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline std::uint32_t hash(std::uint32_t seq) {
+  return (seq * 2654435761u) >> (32 - HashLog);
+}
+
+inline char *write_length(char *op, std::size_t len) {
+  while (len >= 255) {
+    *op++ = static_cast<char>(255);
+    len -= 255;
+  }
+  *op++ = static_cast<char>(len);
+  return op;
+}
+
+inline char *write_sequence(char *op, const char *literals,
+                            std::size_t literalLen, std::size_t offset,
+                            std::size_t matchLen) {
+  char *token = op++;
+  const std::size_t litCode = literalLen < 15 ? literalLen : 15;
+  if (literalLen >= 15)
+    op = write_length(op, literalLen - 15);
+  std::memcpy(op, literals, literalLen);
+  op += literalLen;
+
+  std::size_t matchCode = 0;
+  if (matchLen != 0) {
+    *op++ = static_cast<char>(offset & 0xff);
+    *op++ = static_cast<char>((offset >> 8) & 0xff);
+    const std::size_t extra = matchLen - MinMatch;
+    matchCode = extra < 15 ? extra : 15;
+    if (extra >= 15)
+      op = write_length(op, extra - 15);
+  }
+  *token = static_cast<char>((litCode << 4) | matchCode);
+  return op;
+}
+
+// Compresses src into dst, which must hold compress_bound(n) bytes.
+// Returns the number of bytes written.
+inline std::size_t compress(const char *src, std::size_t n, char *dst) {
+  char *op = dst;
+  std::size_t anchor = 0;
+
+  if (n > MatchFindLimit) {
+    std::vector<std::uint32_t> table(std::size_t{1} << HashLog, UINT32_MAX);
+    const std::size_t matchLimit = n - LastLiterals;
+    std::size_t ip = 0;
+    while (ip < n - MatchFindLimit) {
+      const std::uint32_t seq = read32(src + ip);
+      std::uint32_t &slot = table[hash(seq)];
+      const std::size_t ref = slot;
+      slot = static_cast<std::uint32_t>(ip);
+
+      if (ref == UINT32_MAX || ip - ref > MaxOffset ||
+          read32(src + ref) != seq) {
+        ++ip;
+        continue;
+      }
+
+      std::size_t matchLen = MinMatch;
+      while (ip + matchLen < matchLimit && src[ref + matchLen] == src[ip + matchLen])
+        ++matchLen;
+
+      op = write_sequence(op, src + anchor, ip - anchor, ip - ref, matchLen);
+      ip += matchLen;
+      anchor = ip;
+    }
+  }
+
+  // The final sequence carries only literals.
+  op = write_sequence(op, src + anchor, n - anchor, 0, 0);
+  return static_cast<std::size_t>(op - dst);
+}
+
+// Decompresses exactly rawSize bytes into dst. Returns false on malformed
+// input instead of reading or writing out of bounds.
+inline bool decompress(const char *src, std::size_t n, char *dst,
+                       std::size_t rawSize) {
+  const auto *ip = reinterpret_cast<const unsigned char *>(src);
+  const auto *const iend = ip + n;
+  std::size_t out = 0;
+
+  auto readLength = [&](std::size_t len) -> std::size_t {
+    if (len != 15)
+      return len;
+    unsigned char b;
+    do {
+      if (ip >= iend)
+        return SIZE_MAX;
+      b = *ip++;
+      len += b;
+    } while (b == 255);
+    return len;
+  };
+
+  while (ip < iend) {
+    const unsigned char token = *ip++;
+    const std::size_t literalLen = readLength(token >> 4);
+    if (literalLen == SIZE_MAX ||
+        literalLen > static_cast<std::size_t>(iend - ip) ||
+        literalLen > rawSize - out)
+      return false;
+    std::memcpy(dst + out, ip, literalLen);
+    ip += literalLen;
+    out += literalLen;
+
+    if (ip == iend)
+      break; // Last sequence has no match part.
+
+    if (iend - ip < 2)
+      return false;
+    const std::size_t offset = ip[0] | (static_cast<std::size_t>(ip[1]) << 8);
+    ip += 2;
+    std::size_t matchLen = readLength(token & 0x0f);
+    if (matchLen == SIZE_MAX || offset == 0 || offset > out)
+      return false;
+    matchLen += MinMatch;
+    if (matchLen > rawSize - out)
+      return false;
+    // Overlapping copies are valid and replicate the pattern byte by byte.
+    for (std::size_t i = 0; i < matchLen; ++i, ++out)
+      dst[out] = dst[out - offset];
+  }
+  return out == rawSize;
+}
+
+} // namespace lz4
+
+inline constexpr BlockCodec default_codec() {
+#if defined(LFY_HAS_ZLIB)
+  return BlockCodec::Zlib;
+#else
+  return BlockCodec::Lz4;
+#endif
+}
+
+// Appends a framed block (header + payload) for src to out. Falls back to
+// storing the raw bytes, if compression would not shrink them.
+inline void compress_block(BlockCodec codec, const char *src, std::size_t n,
+                           std::vector<char> &out) {
+  const std::size_t headerPos = out.size();
+  out.resize(headerPos + BlockHeader::Size);
+  const std::size_t payloadPos = out.size();
+
+  BlockHeader header;
+  header.rawSize = static_cast<std::uint32_t>(n);
+  header.codec = codec;
+
+  std::size_t payloadSize = 0;
+  switch (codec) {
+  case BlockCodec::Lz4:
+    out.resize(payloadPos + lz4::compress_bound(n));
+    payloadSize = lz4::compress(src, n, out.data() + payloadPos);
+    break;
+  case BlockCodec::Zlib:
+#if defined(LFY_HAS_ZLIB)
+  {
+    uLongf destLen = ::compressBound(static_cast<uLong>(n));
+    out.resize(payloadPos + destLen);
+    if (::compress2(reinterpret_cast<Bytef *>(out.data() + payloadPos),
+                    &destLen, reinterpret_cast<const Bytef *>(src),
+                    static_cast<uLong>(n), Z_BEST_SPEED) == Z_OK) {
+      payloadSize = destLen;
+      break;
+    }
+  }
+#endif
+    // Zlib unavailable or failed: store the block.
+    payloadSize = n;
+    break;
+  case BlockCodec::Stored:
+    payloadSize = n;
+    break;
+  }
+
+  if (codec == BlockCodec::Stored || payloadSize >= n) {
+    header.codec = BlockCodec::Stored;
+    out.resize(payloadPos + n);
+    std::memcpy(out.data() + payloadPos, src, n);
+    payloadSize = n;
+  }
+
+  out.resize(payloadPos + payloadSize);
+  header.payloadSize = static_cast<std::uint32_t>(payloadSize);
+  encode_header(header, out.data() + headerPos);
+}
+
+// Decodes one framed block from data and appends the raw bytes to out.
+// Returns the number of consumed bytes, or 0 if the block is incomplete or
+// corrupt (e.g. the tail of a file that was cut off by a crash).
+inline std::size_t decompress_block(const char *data, std::size_t n,
+                                    std::string &out) {
+  if (n < BlockHeader::Size)
+    return 0;
+  const BlockHeader header = decode_header(data);
+  if (header.magic != BlockHeader::Magic ||
+      n - BlockHeader::Size < header.payloadSize)
+    return 0;
+
+  const char *payload = data + BlockHeader::Size;
+  const std::size_t start = out.size();
+  out.resize(start + header.rawSize);
+  bool ok = false;
+  switch (header.codec) {
+  case BlockCodec::Stored:
+    ok = header.payloadSize == header.rawSize;
+    if (ok)
+      std::memcpy(out.data() + start, payload, header.rawSize);
+    break;
+  case BlockCodec::Lz4:
+    ok = lz4::decompress(payload, header.payloadSize, out.data() + start,
+                         header.rawSize);
+    break;
+  case BlockCodec::Zlib:
+#if defined(LFY_HAS_ZLIB)
+  {
+    uLongf destLen = header.rawSize;
+    ok = ::uncompress(reinterpret_cast<Bytef *>(out.data() + start), &destLen,
+                      reinterpret_cast<const Bytef *>(payload),
+                      header.payloadSize) == Z_OK &&
+         destLen == header.rawSize;
+  }
+#endif
+  break;
+  }
+
+  if (!ok) {
+    out.resize(start);
+    return 0;
+  }
+  return BlockHeader::Size + header.payloadSize;
+}
+
+} // namespace lfy::details
@@ -0,0 +1,213 @@
+// Unix domain socket transport of the control channel (header-only). Each
+// connection carries one command line and its reply.
+#pragma once
+
+#if defined(_WIN32)
+#error "ControlSocketLinux included on Windows platform"
+#endif
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace lfy::details {
+
+// Longest line accepted from a client.
+inline constexpr std::size_t MaxControlLine = 4096;
+
+// Time a client gets to send its command, or to take the reply.
+inline constexpr auto ControlIoTimeout = std::chrono::seconds(2);
+
+inline bool make_socket_address(const std::filesystem::path &path,
+                                 sockaddr_un &address) {
+  const std::string name = path.string();
+  if (name.size() >= sizeof(address.sun_path))
+    return false;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, name.c_str(), name.size() + 1);
+  return true;
+}
+
+// Waits up to ControlIoTimeout for fd to become ready for events.
+inline bool poll_one(int fd, short events) {
+  const auto timeout =
+      std::chrono::duration_cast<std::chrono::milliseconds>(ControlIoTimeout);
+  pollfd pfd{fd, events, 0};
+  while (true) {
+    const int n = ::poll(&pfd, 1, static_cast<int>(timeout.count()));
+    if (n < 0 && errno == EINTR)
+      continue;
+    return n > 0;
+  }
+}
+
+inline bool send_all(int fd, std::string_view data) {
+  while (!data.empty()) {
+    if (!poll_one(fd, POLLOUT))
+      return false;
+    const ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      return false;
+    }
+    data.remove_prefix(static_cast<std::size_t>(n));
+  }
+  return true;
+}
+
+// Reads until a newline (which is dropped) or the end of the stream.
+inline std::optional<std::string> receive_line(int fd) {
+  std::string line;
+  char buffer[512];
+  while (line.size() <= MaxControlLine) {
+    if (!poll_one(fd, POLLIN))
+      return std::nullopt;
+    const ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      return std::nullopt;
+    }
+    if (n == 0)
+      return line;
+    line.append(buffer, static_cast<std::size_t>(n));
+    if (const std::size_t end = line.find('\n'); end != std::string::npos) {
+      line.resize(end);
+      return line;
+    }
+  }
+  return std::nullopt;
+}
+
+// Listening side. The socket file is only accessible by the owner.
+class ControlSocket {
+public:
+  ControlSocket() = default;
+  ControlSocket(const ControlSocket &) = delete;
+  ControlSocket &operator=(const ControlSocket &) = delete;
+  ~ControlSocket() { close(); }
+
+  bool open(const std::filesystem::path &path) {
+    sockaddr_un address;
+    if (!make_socket_address(path, address))
+      return false;
+    m_listen = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    m_stop = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_listen < 0 || m_stop < 0) {
+      close();
+      return false;
+    }
+    // A socket file left behind by a previous run would fail the bind; any
+    // other file at path is left alone.
+    struct stat status;
+    if (::lstat(address.sun_path, &status) == 0) {
+      if (!S_ISSOCK(status.st_mode)) {
+        close();
+        return false;
+      }
+      ::unlink(address.sun_path);
+    }
+    // Clients cannot connect before listen(), so restricting the file in
+    // between leaves no window.
+    if (::bind(m_listen, reinterpret_cast<sockaddr *>(&address),
+               sizeof(address)) < 0) {
+      close();
+      return false;
+    }
+    m_path = path;
+    if (::chmod(address.sun_path, S_IRUSR | S_IWUSR) < 0 ||
+        ::listen(m_listen, 8) < 0) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  // Blocks until a client connects, returns its descriptor, or -1 after
+  // stop() was called.
+  int accept() {
+    while (true) {
+      pollfd fds[2] = {{m_listen, POLLIN, 0}, {m_stop, POLLIN, 0}};
+      if (::poll(fds, 2, -1) < 0) {
+        if (errno == EINTR)
+          continue;
+        return -1;
+      }
+      if (fds[1].revents != 0)
+        return -1;
+      const int client = ::accept4(m_listen, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client >= 0)
+        return client;
+    }
+  }
+
+  // Wakes up accept(). Safe to call from another thread.
+  void stop() {
+    if (m_stop >= 0) {
+      const std::uint64_t one = 1;
+      [[maybe_unused]] const ssize_t n = ::write(m_stop, &one, sizeof(one));
+    }
+  }
+
+  void close() {
+    if (m_listen >= 0)
+      ::close(m_listen);
+    if (m_stop >= 0)
+      ::close(m_stop);
+    m_listen = m_stop = -1;
+    if (!m_path.empty())
+      ::unlink(m_path.c_str());
+    m_path.clear();
+  }
+
+private:
+  std::filesystem::path m_path;
+  int m_listen{-1};
+  int m_stop{-1};
+};
+
+// Sends one command and returns the complete reply, or nothing if the
+// server cannot be reached.
+inline std::optional<std::string>
+control_request(const std::filesystem::path &path, std::string_view command) {
+  sockaddr_un address;
+  if (!make_socket_address(path, address))
+    return std::nullopt;
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return std::nullopt;
+
+  std::optional<std::string> reply;
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) ==
+          0 &&
+      send_all(fd, std::string(command) + '\n')) {
+    reply.emplace();
+    char buffer[4096];
+    while (poll_one(fd, POLLIN)) {
+      const ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      reply->append(buffer, static_cast<std::size_t>(n));
+    }
+  }
+  ::close(fd);
+  return reply;
+}
+
+} // namespace lfy::details
@@ -0,0 +1,114 @@
+// POSIX helpers for O_DIRECT file outputters (header-only)
+#pragma once
+
+#if defined(_WIN32)
+#error "DirectIoLinux included on Windows platform"
+#endif
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "NativeFileHandleLinux.hpp"
+
+namespace lfy::details {
+
+// Opens for positional, page-cache bypassing writes. Returns an invalid file,
+// if the filesystem rejects O_DIRECT (e.g. tmpfs).
+inline NativeFile open_direct(const std::filesystem::path &p) {
+  NativeFile nf{};
+  nf.fd = ::open(p.string().c_str(), O_WRONLY | O_CREAT | O_DIRECT | O_CLOEXEC,
+                 0644);
+  return nf;
+}
+
+inline NativeFile open_read_write(const std::filesystem::path &p) {
+  NativeFile nf{};
+  nf.fd = ::open(p.string().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  return nf;
+}
+
+// Alignment for O_DIRECT offsets, lengths and buffers. st_blksize is at least
+// the logical block size of the device on all common filesystems.
+inline std::size_t direct_io_alignment(const NativeFile &nf) {
+  struct stat st{};
+  std::size_t alignment = 4096;
+  if (::fstat(nf.fd, &st) == 0 && st.st_blksize > 0)
+    alignment = static_cast<std::size_t>(st.st_blksize);
+  if (alignment < 512 || (alignment & (alignment - 1)) != 0)
+    alignment = 4096;
+  return alignment;
+}
+
+inline std::size_t read_bytes_at(NativeFile &nf, char *data, std::size_t len,
+                                 std::uint64_t offset) {
+  std::size_t total = 0;
+  while (total < len) {
+    ssize_t n = ::pread(nf.fd, data + total, len - total,
+                        static_cast<off_t>(offset + total));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error("FileOutputter: pread failed");
+    }
+    if (n == 0)
+      break;
+    total += static_cast<std::size_t>(n);
+  }
+  return total;
+}
+
+// Owning buffer allocated with posix_memalign.
+class AlignedBuffer {
+public:
+  AlignedBuffer(std::size_t size, std::size_t alignment) : m_size{size} {
+    void *p = nullptr;
+    if (::posix_memalign(&p, alignment, size) != 0)
+      throw std::bad_alloc();
+    m_data = static_cast<char *>(p);
+  }
+  AlignedBuffer(const AlignedBuffer &) = delete;
+  AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+  ~AlignedBuffer() { std::free(m_data); }
+
+  [[nodiscard]] char *data() { return m_data; }
+  [[nodiscard]] std::size_t size() const { return m_size; }
+
+private:
+  char *m_data{nullptr};
+  std::size_t m_size{0};
+};
+
+// Owns a file and closes it on destruction.
+class UniqueFile {
+public:
+  UniqueFile() = default;
+  explicit UniqueFile(NativeFile file) : m_file{file} {}
+  UniqueFile(UniqueFile &&other) noexcept
+      : m_file{std::exchange(other.m_file, NativeFile{})} {}
+  UniqueFile &operator=(UniqueFile &&other) noexcept {
+    if (this != &other) {
+      close_native(m_file);
+      m_file = std::exchange(other.m_file, NativeFile{});
+    }
+    return *this;
+  }
+  ~UniqueFile() { close_native(m_file); }
+
+  [[nodiscard]] NativeFile &get() { return m_file; }
+  [[nodiscard]] const NativeFile &get() const { return m_file; }
+
+private:
+  NativeFile m_file;
+};
+
+} // namespace lfy::details
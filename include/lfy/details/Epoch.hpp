@@ -0,0 +1,186 @@
+// Epoch based reclamation of shared, immutable objects (header-only).
+// Readers pin the current epoch with an EpochGuard while they access such
+// objects without a lock. Writers, which replaced an object, retire it; it is
+// destroyed once every thread which pinned an epoch at or before its
+// retirement left its guard. Pinning costs a store and a fence on a cache
+// line of the thread itself, so readers never contend.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace lfy::details {
+
+namespace epoch {
+
+// Pinned epoch of a thread, 0 while it is not pinned. Slots are reused by
+// later threads and never freed, so there are as many as threads ever ran at
+// the same time.
+struct alignas(64) Slot {
+  std::atomic<std::uint64_t> pinned{0};
+  std::atomic<bool> taken{true};
+  Slot *next{nullptr};
+};
+
+inline std::atomic<std::uint64_t> current{1};
+inline std::atomic<Slot *> slots{nullptr};
+
+inline Slot &thread_slot() {
+  struct Owner {
+    Owner() {
+      for (Slot *slot = slots.load(std::memory_order_acquire);
+           slot != nullptr && m_slot == nullptr; slot = slot->next) {
+        bool taken = false;
+        if (slot->taken.compare_exchange_strong(taken, true,
+                                                std::memory_order_acquire))
+          m_slot = slot;
+      }
+      if (m_slot != nullptr)
+        return;
+      m_slot = new Slot;
+      m_slot->next = slots.load(std::memory_order_relaxed);
+      while (!slots.compare_exchange_weak(m_slot->next, m_slot,
+                                          std::memory_order_release))
+        ;
+    }
+    ~Owner() { m_slot->taken.store(false, std::memory_order_release); }
+
+    Slot *m_slot{nullptr};
+  };
+  thread_local Owner owner;
+  return *owner.m_slot;
+}
+
+struct Retired {
+  std::uint64_t epoch; // Epoch at retirement
+  std::shared_ptr<const void> object;
+};
+
+struct Retirement {
+  std::mutex mutex;
+  std::vector<Retired> objects;
+};
+
+inline Retirement &retirement() {
+  static Retirement instance;
+  return instance;
+}
+
+// Oldest epoch any thread pinned, or the maximum if none is pinned.
+inline std::uint64_t oldest_pinned() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+  for (Slot *slot = slots.load(std::memory_order_acquire); slot != nullptr;
+       slot = slot->next) {
+    const std::uint64_t pinned = slot->pinned.load(std::memory_order_acquire);
+    if (pinned != 0)
+      oldest = std::min(oldest, pinned);
+  }
+  return oldest;
+}
+
+} // namespace epoch
+
+// Pins the current epoch for its lifetime. Guards nest, only the outermost
+// one of a thread pins.
+class EpochGuard {
+public:
+  EpochGuard()
+      : m_slot{epoch::thread_slot()},
+        m_outer{m_slot.pinned.load(std::memory_order_relaxed) == 0} {
+    if (!m_outer)
+      return;
+    m_slot.pinned.store(epoch::current.load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+    // Orders the store before all loads of the shared objects, and the load
+    // of the epoch before them as well
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  ~EpochGuard() {
+    if (m_outer)
+      m_slot.pinned.store(0, std::memory_order_release);
+  }
+
+  EpochGuard(const EpochGuard &) = delete;
+  EpochGuard &operator=(const EpochGuard &) = delete;
+
+  // Whether the calling thread is inside a guard.
+  static bool pinned() {
+    return epoch::thread_slot().pinned.load(std::memory_order_relaxed) != 0;
+  }
+
+private:
+  epoch::Slot &m_slot;
+  const bool m_outer;
+};
+
+// Destroys object once no guard, which might still reach it, exists. Has to
+// be called after object got unreachable for new guards.
+template <typename T> void retire(std::unique_ptr<T> object) {
+  if (object == nullptr)
+    return;
+  epoch::Retirement &retirement = epoch::retirement();
+  std::lock_guard l{retirement.mutex};
+  retirement.objects.push_back(
+      {epoch::current.fetch_add(1, std::memory_order_seq_cst),
+       std::shared_ptr<const void>(std::move(object))});
+}
+
+// Destroys the retired objects which are unreachable by now. Returns the
+// number of objects which are still retired.
+inline std::size_t reclaim_retired() {
+  std::vector<epoch::Retired> expired;
+  std::size_t remaining = 0;
+  {
+    epoch::Retirement &retirement = epoch::retirement();
+    std::lock_guard l{retirement.mutex};
+    const std::uint64_t oldest = epoch::oldest_pinned();
+    auto unreachable = std::stable_partition(
+        retirement.objects.begin(), retirement.objects.end(),
+        [oldest](const epoch::Retired &retired) {
+          return retired.epoch >= oldest;
+        });
+    expired.assign(std::make_move_iterator(unreachable),
+                   std::make_move_iterator(retirement.objects.end()));
+    retirement.objects.erase(unreachable, retirement.objects.end());
+    remaining = retirement.objects.size();
+  }
+  // Destroyed without the lock, destructors may retire objects themselves
+  expired.clear();
+  return remaining;
+}
+
+// Waits until all objects retired so far are destroyed, i.e. until all guards
+// which existed at the time of the call are gone. Within a guard, it only
+// reclaims what it can, as it would wait for itself.
+inline void synchronize_retired() {
+  if (EpochGuard::pinned()) {
+    reclaim_retired();
+    return;
+  }
+  const std::uint64_t target = epoch::current.load(std::memory_order_seq_cst);
+  while (reclaim_retired() != 0) {
+    {
+      epoch::Retirement &retirement = epoch::retirement();
+      std::lock_guard l{retirement.mutex};
+      if (std::none_of(retirement.objects.begin(), retirement.objects.end(),
+                       [target](const epoch::Retired &retired) {
+                         return retired.epoch < target;
+                       }))
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+} // namespace lfy::details
@@ -0,0 +1,99 @@
+// Linux-specific file change notification, based on inotify
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace lfy::details {
+
+// Reports changes of a single file. The directory is watched instead of the
+// file itself, so replacing the file with rename (as editors and deployment
+// tools do) is noticed as well.
+class FileWatch {
+public:
+  FileWatch() = default;
+  FileWatch(const FileWatch &) = delete;
+  FileWatch &operator=(const FileWatch &) = delete;
+  ~FileWatch() { close(); }
+
+  bool open(const std::filesystem::path &file) {
+    const std::filesystem::path absolute = std::filesystem::absolute(file);
+    m_name = absolute.filename().string();
+    m_inotify = ::inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    m_stop = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_inotify < 0 || m_stop < 0) {
+      close();
+      return false;
+    }
+    if (::inotify_add_watch(m_inotify, absolute.parent_path().c_str(),
+                            IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  // Blocks until the file changed (true) or stop() was called (false).
+  bool wait() {
+    while (true) {
+      pollfd fds[2] = {{m_inotify, POLLIN, 0}, {m_stop, POLLIN, 0}};
+      if (::poll(fds, 2, -1) < 0) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      if (fds[1].revents != 0)
+        return false;
+      if (drainEvents())
+        return true;
+    }
+  }
+
+  // Wakes up wait(). Safe to call from another thread.
+  void stop() {
+    if (m_stop >= 0) {
+      const std::uint64_t one = 1;
+      [[maybe_unused]] const ssize_t n = ::write(m_stop, &one, sizeof(one));
+    }
+  }
+
+  void close() {
+    if (m_inotify >= 0)
+      ::close(m_inotify);
+    if (m_stop >= 0)
+      ::close(m_stop);
+    m_inotify = m_stop = -1;
+  }
+
+private:
+  // Reads all pending events, returns whether one concerns the file.
+  bool drainEvents() {
+    alignas(inotify_event) char buffer[4096];
+    bool changed = false;
+    while (true) {
+      const ssize_t n = ::read(m_inotify, buffer, sizeof(buffer));
+      if (n <= 0)
+        return changed;
+      for (ssize_t pos = 0; pos < n;) {
+        const auto *event =
+            reinterpret_cast<const inotify_event *>(buffer + pos);
+        if (event->len != 0 && m_name == event->name)
+          changed = true;
+        pos += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+      }
+    }
+  }
+
+  std::string m_name;
+  int m_inotify{-1};
+  int m_stop{-1};
+};
+
+} // namespace lfy::details
@@ -0,0 +1,69 @@
+// Windows-specific file change notification, based on polling the last write
+// time of the file
+#pragma once
+
+#ifndef _WIN32
+#error "FileWatchWindows.hpp included on non-Windows platform"
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <system_error>
+
+namespace lfy::details {
+
+class FileWatch {
+public:
+  FileWatch() = default;
+  FileWatch(const FileWatch &) = delete;
+  FileWatch &operator=(const FileWatch &) = delete;
+
+  bool open(const std::filesystem::path &file) {
+    m_file = file;
+    m_lastWrite = lastWriteTime();
+    return true;
+  }
+
+  // Blocks until the file changed (true) or stop() was called (false).
+  bool wait() {
+    std::unique_lock l{m_mutex};
+    while (!m_stopped) {
+      m_cv.wait_for(l, PollInterval);
+      const auto lastWrite = lastWriteTime();
+      if (lastWrite != m_lastWrite) {
+        m_lastWrite = lastWrite;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Wakes up wait(). Safe to call from another thread.
+  void stop() {
+    {
+      std::lock_guard l{m_mutex};
+      m_stopped = true;
+    }
+    m_cv.notify_all();
+  }
+
+  void close() {}
+
+private:
+  static constexpr auto PollInterval = std::chrono::milliseconds(500);
+
+  std::filesystem::file_time_type lastWriteTime() const {
+    std::error_code ec;
+    return std::filesystem::last_write_time(m_file, ec);
+  }
+
+  std::filesystem::path m_file;
+  std::filesystem::file_time_type m_lastWrite{};
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_stopped{false};
+};
+
+} // namespace lfy::details
@@ -0,0 +1,11 @@
+#pragma once
+
+#if defined(_WIN32)
+#include <lfy/details/FileWatchWindows.hpp>
+
+#elif defined(__linux__)
+#include <lfy/details/FileWatchLinux.hpp>
+
+#else
+#error "Unsupported platform for file watching"
+#endif
@@ -0,0 +1,23 @@
+// Small, constexpr capable hash functions (header-only)
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace lfy::details {
+
+inline constexpr std::uint64_t Fnv1aOffsetBasis = 14695981039346656037ull;
+inline constexpr std::uint64_t Fnv1aPrime = 1099511628211ull;
+
+// 64 bit FNV-1a. Pass a previous result as seed to hash several pieces.
+constexpr std::uint64_t fnv1a(std::string_view data,
+                              std::uint64_t seed = Fnv1aOffsetBasis) {
+  std::uint64_t hash = seed;
+  for (const char c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= Fnv1aPrime;
+  }
+  return hash;
+}
+
+} // namespace lfy::details
@@ -0,0 +1,343 @@
+// Minimal JSON reader for configuration files (header-only).
+// Objects keep the order of their members; duplicate members are rejected,
+// as only one of them could take effect. Errors are reported as
+// std::runtime_error with the byte offset of the problem.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace lfy::details {
+
+class JsonValue {
+public:
+  using Array = std::vector<JsonValue>;
+  using Object = std::vector<std::pair<std::string, JsonValue>>;
+
+  JsonValue() = default;
+  explicit JsonValue(bool value) : m_value{value} {}
+  explicit JsonValue(double value) : m_value{value} {}
+  explicit JsonValue(std::string value) : m_value{std::move(value)} {}
+  explicit JsonValue(Array value) : m_value{std::move(value)} {}
+  explicit JsonValue(Object value) : m_value{std::move(value)} {}
+
+  bool isNull() const { return is<std::nullptr_t>(); }
+  bool isBool() const { return is<bool>(); }
+  bool isNumber() const { return is<double>(); }
+  bool isString() const { return is<std::string>(); }
+  bool isArray() const { return is<Array>(); }
+  bool isObject() const { return is<Object>(); }
+
+  bool asBool() const { return get<bool>("a boolean"); }
+  double asNumber() const { return get<double>("a number"); }
+  const std::string &asString() const { return get<std::string>("a string"); }
+  const Array &asArray() const { return get<Array>("an array"); }
+  const Object &asObject() const { return get<Object>("an object"); }
+
+  // Member of an object, or nullptr if there is none.
+  const JsonValue *find(std::string_view key) const {
+    for (const auto &[name, value] : asObject())
+      if (name == key)
+        return &value;
+    return nullptr;
+  }
+
+  // Compact serialization, e.g. to compare values.
+  std::string dump() const {
+    std::string out;
+    dumpTo(out);
+    return out;
+  }
+
+private:
+  template <typename T> bool is() const {
+    return std::holds_alternative<T>(m_value);
+  }
+
+  template <typename T> const T &get(const char *expected) const {
+    if (const T *value = std::get_if<T>(&m_value))
+      return *value;
+    throw std::runtime_error(std::string("json: expected ") + expected);
+  }
+
+  static void dumpString(std::string &out, std::string_view str) {
+    out.push_back('"');
+    for (const char c : str) {
+      if (c == '"' || c == '\\') {
+        out.push_back('\\');
+        out.push_back(c);
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        constexpr char Hex[] = "0123456789abcdef";
+        out.append("\\u00");
+        out.push_back(Hex[(c >> 4) & 0xf]);
+        out.push_back(Hex[c & 0xf]);
+      } else {
+        out.push_back(c);
+      }
+    }
+    out.push_back('"');
+  }
+
+  void dumpTo(std::string &out) const {
+    if (isNull()) {
+      out.append("null");
+    } else if (isBool()) {
+      out.append(asBool() ? "true" : "false");
+    } else if (isNumber()) {
+      out.append(std::to_string(asNumber()));
+    } else if (isString()) {
+      dumpString(out, asString());
+    } else if (isArray()) {
+      out.push_back('[');
+      for (const JsonValue &value : asArray()) {
+        if (out.back() != '[')
+          out.push_back(',');
+        value.dumpTo(out);
+      }
+      out.push_back(']');
+    } else {
+      out.push_back('{');
+      for (const auto &[name, value] : asObject()) {
+        if (out.back() != '{')
+          out.push_back(',');
+        dumpString(out, name);
+        out.push_back(':');
+        value.dumpTo(out);
+      }
+      out.push_back('}');
+    }
+  }
+
+  std::variant<std::nullptr_t, bool, double, std::string, Array, Object>
+      m_value{nullptr};
+};
+
+class JsonParser {
+public:
+  explicit JsonParser(std::string_view text) : m_text{text} {}
+
+  JsonValue parse() {
+    JsonValue value = parseValue(0);
+    skipWhitespace();
+    if (m_pos != m_text.size())
+      fail("unexpected trailing characters");
+    return value;
+  }
+
+private:
+  static constexpr unsigned MaxDepth = 64;
+
+  [[noreturn]] void fail(const char *what) const {
+    throw std::runtime_error("json: " + std::string(what) + " at offset " +
+                             std::to_string(m_pos));
+  }
+
+  void skipWhitespace() {
+    while (m_pos < m_text.size() &&
+           (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' ||
+            m_text[m_pos] == '\n' || m_text[m_pos] == '\r'))
+      ++m_pos;
+  }
+
+  bool consume(char c) {
+    skipWhitespace();
+    if (m_pos < m_text.size() && m_text[m_pos] == c) {
+      ++m_pos;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(char c) {
+    if (!consume(c))
+      fail((std::string("expected '") + c + "'").c_str());
+  }
+
+  bool consumeLiteral(std::string_view literal) {
+    if (m_text.substr(m_pos, literal.size()) != literal)
+      return false;
+    m_pos += literal.size();
+    return true;
+  }
+
+  JsonValue parseValue(unsigned depth) {
+    if (depth > MaxDepth)
+      fail("nesting too deep");
+    skipWhitespace();
+    if (m_pos == m_text.size())
+      fail("unexpected end of input");
+
+    const char c = m_text[m_pos];
+    if (c == '{')
+      return parseObject(depth);
+    if (c == '[')
+      return parseArray(depth);
+    if (c == '"')
+      return JsonValue{parseString()};
+    if (consumeLiteral("true"))
+      return JsonValue{true};
+    if (consumeLiteral("false"))
+      return JsonValue{false};
+    if (consumeLiteral("null"))
+      return JsonValue{};
+    return JsonValue{parseNumber()};
+  }
+
+  JsonValue parseObject(unsigned depth) {
+    expect('{');
+    JsonValue::Object object;
+    if (consume('}'))
+      return JsonValue{std::move(object)};
+    do {
+      skipWhitespace();
+      std::string name = parseString();
+      for (const auto &member : object)
+        if (member.first == name)
+          fail(("duplicate member '" + name + "'").c_str());
+      expect(':');
+      object.emplace_back(std::move(name), parseValue(depth + 1));
+    } while (consume(','));
+    expect('}');
+    return JsonValue{std::move(object)};
+  }
+
+  JsonValue parseArray(unsigned depth) {
+    expect('[');
+    JsonValue::Array array;
+    if (consume(']'))
+      return JsonValue{std::move(array)};
+    do {
+      array.push_back(parseValue(depth + 1));
+    } while (consume(','));
+    expect(']');
+    return JsonValue{std::move(array)};
+  }
+
+  double parseNumber() {
+    const std::size_t start = m_pos;
+    if (m_pos < m_text.size() && m_text[m_pos] == '-')
+      ++m_pos;
+    auto digits = [this] {
+      const std::size_t from = m_pos;
+      while (m_pos < m_text.size() && m_text[m_pos] >= '0' &&
+             m_text[m_pos] <= '9')
+        ++m_pos;
+      return m_pos - from;
+    };
+    if (digits() == 0)
+      fail("invalid value");
+    if (m_pos < m_text.size() && m_text[m_pos] == '.') {
+      ++m_pos;
+      if (digits() == 0)
+        fail("invalid number");
+    }
+    auto next = [this](std::string_view chars) {
+      return m_pos < m_text.size() &&
+             chars.find(m_text[m_pos]) != std::string_view::npos;
+    };
+    if (next("eE")) {
+      ++m_pos;
+      if (next("+-"))
+        ++m_pos;
+      if (digits() == 0)
+        fail("invalid number");
+    }
+    const std::string token(m_text.substr(start, m_pos - start));
+    return std::strtod(token.c_str(), nullptr);
+  }
+
+  unsigned parseHex4() {
+    if (m_text.size() - m_pos < 4)
+      fail("invalid unicode escape");
+    unsigned value = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = m_text[m_pos++];
+      value <<= 4;
+      if (c >= '0' && c <= '9')
+        value |= static_cast<unsigned>(c - '0');
+      else if (c >= 'a' && c <= 'f')
+        value |= static_cast<unsigned>(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F')
+        value |= static_cast<unsigned>(c - 'A' + 10);
+      else
+        fail("invalid unicode escape");
+    }
+    return value;
+  }
+
+  static void appendUtf8(std::string &out, std::uint32_t cp) {
+    if (cp < 0x80) {
+      out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+      out.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else if (cp < 0x10000) {
+      out.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else {
+      out.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    }
+  }
+
+  std::string parseString() {
+    if (m_pos == m_text.size() || m_text[m_pos] != '"')
+      fail("expected string");
+    ++m_pos;
+    std::string out;
+    while (true) {
+      if (m_pos == m_text.size())
+        fail("unterminated string");
+      const char c = m_text[m_pos++];
+      if (c == '"')
+        return out;
+      if (static_cast<unsigned char>(c) < 0x20)
+        fail("control character in string");
+      if (c != '\\') {
+        out.push_back(c);
+        continue;
+      }
+      if (m_pos == m_text.size())
+        fail("unterminated string");
+      const char escape = m_text[m_pos++];
+      if (escape == 'u') {
+        std::uint32_t cp = parseHex4();
+        if (cp >= 0xd800 && cp < 0xdc00) {
+          if (!consumeLiteral("\\u"))
+            fail("unpaired surrogate");
+          const std::uint32_t low = parseHex4();
+          if (low < 0xdc00 || low >= 0xe000)
+            fail("unpaired surrogate");
+          cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+        }
+        appendUtf8(out, cp);
+        continue;
+      }
+      constexpr std::string_view Escapes = "\"\\/bfnrt";
+      constexpr std::string_view Unescaped = "\"\\/\b\f\n\r\t";
+      const std::size_t index = Escapes.find(escape);
+      if (index == std::string_view::npos)
+        fail("invalid escape");
+      out.push_back(Unescaped[index]);
+    }
+  }
+
+  std::string_view m_text;
+  std::size_t m_pos{0};
+};
+
+inline JsonValue parse_json(std::string_view text) {
+  return JsonParser{text}.parse();
+}
+
+} // namespace lfy::details
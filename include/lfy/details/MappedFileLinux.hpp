@@ -0,0 +1,83 @@
+// POSIX helpers for memory-mapped file outputters (header-only)
+#pragma once
+
+#if defined(_WIN32)
+#error "MappedFileLinux included on Windows platform"
+#endif
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "NativeFileHandleLinux.hpp"
+
+namespace lfy::details {
+
+// Shared mappings need a descriptor opened for reading and writing.
+inline NativeFile open_for_mapping(const std::filesystem::path &p) {
+  NativeFile nf{};
+  nf.fd = ::open(p.string().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  return nf;
+}
+
+inline std::size_t page_size() {
+  static const std::size_t size =
+      static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+// Grows the file to at least offset + len bytes. Uses real block allocation
+// where the filesystem supports it, and a sparse extension otherwise.
+inline void preallocate(NativeFile &nf, std::uint64_t offset,
+                        std::uint64_t len) {
+  int rc;
+  do {
+    rc = ::fallocate(nf.fd, 0, static_cast<off_t>(offset),
+                     static_cast<off_t>(len));
+  } while (rc != 0 && errno == EINTR);
+  if (rc == 0)
+    return;
+  if (errno != EOPNOTSUPP && errno != ENOSYS)
+    throw std::runtime_error("MappedFileOutputter: fallocate failed");
+  if (file_size(nf) < offset + len &&
+      ::ftruncate(nf.fd, static_cast<off_t>(offset + len)) != 0)
+    throw std::runtime_error("MappedFileOutputter: ftruncate failed");
+}
+
+// Maps [offset, offset + len) of the file. Pages are prefaulted, so writers
+// do not take page faults inside the window.
+inline char *map_shared(NativeFile &nf, std::uint64_t offset,
+                        std::size_t len) {
+  void *p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, nf.fd, static_cast<off_t>(offset));
+  if (p == MAP_FAILED)
+    throw std::runtime_error("MappedFileOutputter: mmap failed");
+  return static_cast<char *>(p);
+}
+
+inline void unmap(char *base, std::size_t len) {
+  if (base != nullptr)
+    ::munmap(base, len);
+}
+
+// Whether both descriptors refer to the same inode.
+inline bool same_file(const NativeFile &a, const NativeFile &b) {
+  struct stat sa{};
+  struct stat sb{};
+  return ::fstat(a.fd, &sa) == 0 && ::fstat(b.fd, &sb) == 0 &&
+         sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+inline void truncate_to(NativeFile &nf, std::uint64_t size) {
+  if (::ftruncate(nf.fd, static_cast<off_t>(size)) != 0)
+    throw std::runtime_error("MappedFileOutputter: ftruncate failed");
+}
+
+} // namespace lfy::details
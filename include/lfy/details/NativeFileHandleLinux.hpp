@@ -7,6 +7,7 @@
 
 #include <cerrno>
 #include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <stdexcept>
 #include <string>
@@ -16,12 +17,17 @@
 #include <sys/uio.h>
 #include <unistd.h>
 
+#include "Probes.hpp"
+
 namespace lfy::details {
 
 struct NativeFile {
   int fd{-1};
 };
 
+// Write system calls issued by the calling thread, for outputter metrics.
+inline thread_local std::uint64_t writeSyscalls{0};
+
 inline NativeFile open_for_append(const std::filesystem::path &p) {
   NativeFile nf{};
   nf.fd = ::open(p.string().c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
@@ -38,9 +44,18 @@ inline void close_native(NativeFile &nf) {
   }
 }
 
+inline std::uint64_t file_size(const NativeFile &nf) {
+  struct stat st{};
+  if (::fstat(nf.fd, &st) != 0)
+    throw std::runtime_error("FileOutputter: fstat failed");
+  return static_cast<std::uint64_t>(st.st_size);
+}
+
 inline void write_bytes(NativeFile &nf, const char *data, std::size_t len) {
+  LFY_PROBE(write_start, nf.fd, len);
   std::size_t total = 0;
   while (total < len) {
+    ++writeSyscalls;
     ssize_t written = ::write(nf.fd, data + total, len - total);
     if (written < 0) {
       if (errno == EINTR)
@@ -51,12 +66,34 @@ inline void write_bytes(NativeFile &nf, const char *data, std::size_t len) {
       throw std::runtime_error("FileOutputter: write returned 0");
     total += static_cast<std::size_t>(written);
   }
+  LFY_PROBE(write_done, nf.fd, len);
+}
+
+// Positional write. Linux ignores the offset for O_APPEND descriptors, so
+// only use it on files opened without O_APPEND.
+inline void write_bytes_at(NativeFile &nf, const char *data, std::size_t len,
+                           std::uint64_t offset) {
+  std::size_t total = 0;
+  while (total < len) {
+    ++writeSyscalls;
+    ssize_t written = ::pwrite(nf.fd, data + total, len - total,
+                               static_cast<off_t>(offset + total));
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error("FileOutputter: pwrite failed");
+    }
+    if (written == 0)
+      throw std::runtime_error("FileOutputter: pwrite returned 0");
+    total += static_cast<std::size_t>(written);
+  }
 }
 
 inline void write_line(NativeFile &nf, const char *data, std::size_t len) {
   struct iovec vec[2]{{const_cast<char *>(data), len},
                       {const_cast<char *>("\n"), 1}};
   std::size_t expected = len + 1;
+  ++writeSyscalls;
   ssize_t written = ::writev(nf.fd, vec, 2);
   if (written < 0) {
     if (errno == EINTR) {
@@ -83,4 +120,37 @@ inline void write_line(NativeFile &nf, const char *data, std::size_t len) {
   }
 }
 
+// Forces written data (and the metadata needed to read it) to the device.
+inline void sync_data(NativeFile &nf) {
+  int rc;
+  do {
+    rc = ::fdatasync(nf.fd);
+  } while (rc != 0 && errno == EINTR);
+  if (rc != 0)
+    throw std::runtime_error("FileOutputter: fdatasync failed");
+}
+
+// Starts asynchronous writeback of a file range.
+inline void start_writeback(NativeFile &nf, std::uint64_t offset,
+                            std::uint64_t len) {
+  ::sync_file_range(nf.fd, static_cast<off64_t>(offset),
+                    static_cast<off64_t>(len), SYNC_FILE_RANGE_WRITE);
+}
+
+// Waits until writeback of a file range, which was started before, is done.
+inline void wait_writeback(NativeFile &nf, std::uint64_t offset,
+                           std::uint64_t len) {
+  ::sync_file_range(nf.fd, static_cast<off64_t>(offset),
+                    static_cast<off64_t>(len),
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                        SYNC_FILE_RANGE_WAIT_AFTER);
+}
+
+// Evicts clean pages of a file range from the page cache.
+inline void drop_cached(NativeFile &nf, std::uint64_t offset,
+                        std::uint64_t len) {
+  ::posix_fadvise(nf.fd, static_cast<off_t>(offset), static_cast<off_t>(len),
+                  POSIX_FADV_DONTNEED);
+}
+
 } // namespace lfy::details
@@ -8,6 +8,7 @@
 #include <windows.h>
 
 #include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <stdexcept>
 #include <string>
@@ -19,6 +20,9 @@ struct NativeFile {
   HANDLE handle{INVALID_HANDLE_VALUE};
 };
 
+// Write system calls issued by the calling thread, for outputter metrics.
+inline thread_local std::uint64_t writeSyscalls{0};
+
 inline NativeFile open_for_append(const std::filesystem::path &p) {
   NativeFile nf{};
   nf.handle =
@@ -39,12 +43,20 @@ inline void close_native(NativeFile &nf) {
   }
 }
 
+inline std::uint64_t file_size(const NativeFile &nf) {
+  LARGE_INTEGER size{};
+  if (!::GetFileSizeEx(nf.handle, &size))
+    throw std::runtime_error("FileOutputter: GetFileSizeEx failed");
+  return static_cast<std::uint64_t>(size.QuadPart);
+}
+
 inline void write_bytes(NativeFile &nf, const char *data, std::size_t len) {
   std::size_t total = 0;
   while (total < len) {
     DWORD written = 0;
     DWORD toWrite = static_cast<DWORD>(std::min<std::size_t>(
         len - total, static_cast<std::size_t>(UINT32_MAX)));
+    ++writeSyscalls;
     if (!::WriteFile(nf.handle, data + total, toWrite, &written, nullptr)) {
       throw std::runtime_error("FileOutputter: WriteFile failed");
     }
@@ -65,4 +77,15 @@ inline void write_line(NativeFile &nf, const char *data, std::size_t len) {
   write_bytes(nf, tmp.data(), tmp.size());
 }
 
+inline void sync_data(NativeFile &nf) {
+  if (!::FlushFileBuffers(nf.handle))
+    throw std::runtime_error("FileOutputter: FlushFileBuffers failed");
+}
+
+// Windows has no range based writeback control; the cache manager's lazy
+// writer already trickles dirty pages. These are no-ops.
+inline void start_writeback(NativeFile &, std::uint64_t, std::uint64_t) {}
+inline void wait_writeback(NativeFile &, std::uint64_t, std::uint64_t) {}
+inline void drop_cached(NativeFile &, std::uint64_t, std::uint64_t) {}
+
 } // namespace lfy::details
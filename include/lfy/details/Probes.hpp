@@ -0,0 +1,104 @@
+// USDT (user statically defined tracing) probes, compatible with the probes
+// of <sys/sdt.h>, e.g. to trace flushes of a running process:
+//
+//   bpftrace -e 'usdt:./app:lfy:flush_start { @start[arg0] = nsecs; }
+//                usdt:./app:lfy:flush_done /@start[arg0]/ {
+//                  @us = hist((nsecs - @start[arg0]) / 1000); }'
+//
+// Built with LFY_USDT on x86-64 or AArch64 Linux, a probe is a single nop
+// plus an ELF note describing where its arguments live; a tracer replaces the
+// nop with a breakpoint when attaching. Otherwise probes compile to nothing.
+// Arguments are integers or pointers, passed as 64 bit unsigned values.
+//
+// Probes (provider lfy):
+//   log_start(logger name, level)       A record passed the level checks.
+//   log_formatted(logger name, size)    The record was formatted.
+//   log_done(logger name)               All outputters accepted the record.
+//   flush_start(outputter, size)        A buffer is handed to the system.
+//   flush_done(outputter, size)
+//   write_start(fd, size)               details::write_bytes
+//   write_done(fd, size)
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#if defined(LFY_USDT) && defined(__linux__) &&                               \
+    (defined(__x86_64__) || defined(__aarch64__))
+
+namespace lfy::details {
+
+template <typename T> std::uint64_t probe_argument(T value) {
+  if constexpr (std::is_pointer_v<T>)
+    return reinterpret_cast<std::uintptr_t>(value);
+  else
+    return static_cast<std::uint64_t>(value);
+}
+
+} // namespace lfy::details
+
+#define LFY_DETAILS_PROBE_COUNT(...)                                          \
+  LFY_DETAILS_PROBE_COUNT_(__VA_OPT__(__VA_ARGS__, ) 4, 3, 2, 1, 0)
+#define LFY_DETAILS_PROBE_COUNT_(a, b, c, d, n, ...) n
+#define LFY_DETAILS_PROBE_CAT(a, b) LFY_DETAILS_PROBE_CAT_(a, b)
+#define LFY_DETAILS_PROBE_CAT_(a, b) a##b
+
+// Argument descriptions of the note, "<size>@<operand>" each
+#define LFY_DETAILS_PROBE_FORMAT0 ""
+#define LFY_DETAILS_PROBE_FORMAT1 "8@%0"
+#define LFY_DETAILS_PROBE_FORMAT2 "8@%0 8@%1"
+#define LFY_DETAILS_PROBE_FORMAT3 "8@%0 8@%1 8@%2"
+#define LFY_DETAILS_PROBE_FORMAT4 "8@%0 8@%1 8@%2 8@%3"
+
+#define LFY_DETAILS_PROBE_OPERAND(x)                                          \
+  "nor"(::lfy::details::probe_argument(x))
+#define LFY_DETAILS_PROBE_OPERANDS0()
+#define LFY_DETAILS_PROBE_OPERANDS1(a) LFY_DETAILS_PROBE_OPERAND(a)
+#define LFY_DETAILS_PROBE_OPERANDS2(a, b)                                     \
+  LFY_DETAILS_PROBE_OPERAND(a), LFY_DETAILS_PROBE_OPERAND(b)
+#define LFY_DETAILS_PROBE_OPERANDS3(a, b, c)                                  \
+  LFY_DETAILS_PROBE_OPERANDS2(a, b), LFY_DETAILS_PROBE_OPERAND(c)
+#define LFY_DETAILS_PROBE_OPERANDS4(a, b, c, d)                               \
+  LFY_DETAILS_PROBE_OPERANDS3(a, b, c), LFY_DETAILS_PROBE_OPERAND(d)
+
+// The note layout of <sys/sdt.h>: probe address, base address for prelink
+// adjustments, semaphore (none), provider, name, arguments. The note joins
+// the section group of the enclosing function ("?"), so probes in inline
+// functions are discarded together with unused copies of them.
+#define LFY_DETAILS_PROBE(name, n, ...)                                       \
+  __asm__ __volatile__(                                                       \
+      "990: nop\n"                                                            \
+      ".pushsection .note.stapsdt,\"?\",\"note\"\n"                           \
+      ".balign 4\n"                                                           \
+      ".4byte 992f-991f, 994f-993f, 3\n"                                      \
+      "991: .asciz \"stapsdt\"\n"                                             \
+      "992: .balign 4\n"                                                      \
+      "993: .8byte 990b\n"                                                    \
+      ".8byte _.stapsdt.base\n"                                               \
+      ".8byte 0\n"                                                            \
+      ".asciz \"lfy\"\n"                                                      \
+      ".asciz \"" #name "\"\n"                                                \
+      ".asciz \"" LFY_DETAILS_PROBE_CAT(LFY_DETAILS_PROBE_FORMAT, n) "\"\n"   \
+      "994: .balign 4\n"                                                      \
+      ".popsection\n"                                                         \
+      ".ifndef _.stapsdt.base\n"                                              \
+      ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+      ".weak _.stapsdt.base\n"                                                \
+      ".hidden _.stapsdt.base\n"                                              \
+      "_.stapsdt.base: .space 1\n"                                            \
+      ".size _.stapsdt.base, 1\n"                                             \
+      ".popsection\n"                                                         \
+      ".endif\n"                                                              \
+      :                                                                       \
+      : LFY_DETAILS_PROBE_CAT(LFY_DETAILS_PROBE_OPERANDS, n)(__VA_ARGS__))
+
+// LFY_PROBE(name, args...) with up to four arguments.
+#define LFY_PROBE(name, ...)                                                  \
+  LFY_DETAILS_PROBE(name, LFY_DETAILS_PROBE_COUNT(__VA_ARGS__)                \
+                              __VA_OPT__(, ) __VA_ARGS__)
+
+#else
+
+#define LFY_PROBE(name, ...) static_cast<void>(0)
+
+#endif
@@ -20,13 +20,10 @@ inline std::tm toLocalTm(std::time_t t) {
   return tm;
 }
 
+// Offset of local time east of UTC, as determined by localtime_r. Unlike
+// mktime, reading it neither reloads the time zone nor allocates.
 inline int getLocalTimeZoneOffsetMinutes(const std::tm &localTm) {
-  std::tm localCopy = localTm;
-  std::tm utcCopy = localTm; // treat as UTC structure for conversion
-  time_t localEpoch = mktime(&localCopy); // interprets as local time
-  time_t utcEpoch = timegm(&utcCopy);     // interprets as UTC
-  double diffSeconds = difftime(localEpoch, utcEpoch); // local - utc
-  return static_cast<int>(diffSeconds / 60);
+  return static_cast<int>(localTm.tm_gmtoff / 60);
 }
 
 } // namespace details
@@ -10,6 +10,8 @@
 
 #include <ctime>
 
+namespace lfy {
+
 namespace details {
 
 inline std::tm toUtcTm(std::time_t t) {
@@ -35,3 +37,5 @@ inline int getLocalTimeZoneOffsetMinutes(const std::tm &time) {
 }
 
 } // namespace details
+
+} // namespace lfy
@@ -0,0 +1,190 @@
+// Minimal io_uring submission/completion ring on top of raw syscalls
+// (header-only, no liburing dependency). Only supports what the uring file
+// outputter needs: fixed-buffer writes to a registered file.
+#pragma once
+
+#if defined(_WIN32)
+#error "UringLinux included on Windows platform"
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace lfy::details {
+
+struct UringCompletion {
+  std::uint64_t userData;
+  std::int32_t result;
+};
+
+class Uring {
+public:
+  Uring() = default;
+  Uring(const Uring &) = delete;
+  Uring &operator=(const Uring &) = delete;
+  ~Uring() { close(); }
+
+  // Returns false, if the kernel does not provide io_uring (or forbids it).
+  bool setup(unsigned entries) {
+    io_uring_params params{};
+    const long fd = ::syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+      return false;
+    m_ringFd = static_cast<int>(fd);
+
+    // Older kernels map the rings separately; keep it simple and require the
+    // single-mmap layout available since 5.4.
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+      close();
+      return false;
+    }
+
+    const std::size_t sqSize =
+        params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    const std::size_t cqSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_ringSize = sqSize > cqSize ? sqSize : cqSize;
+    m_ring = ::mmap(nullptr, m_ringSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+    if (m_ring == MAP_FAILED) {
+      m_ring = nullptr;
+      close();
+      return false;
+    }
+
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      close();
+      return false;
+    }
+    m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+    auto *base = static_cast<char *>(m_ring);
+    m_sqHead = reinterpret_cast<unsigned *>(base + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned *>(base + params.sq_off.tail);
+    m_sqMask = *reinterpret_cast<unsigned *>(base + params.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<unsigned *>(base + params.sq_off.array);
+    m_cqHead = reinterpret_cast<unsigned *>(base + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned *>(base + params.cq_off.tail);
+    m_cqMask = *reinterpret_cast<unsigned *>(base + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe *>(base + params.cq_off.cqes);
+    m_sqEntries = params.sq_entries;
+    return true;
+  }
+
+  bool registerBuffers(const iovec *buffers, unsigned count) {
+    return ::syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_BUFFERS,
+                     buffers, count) == 0;
+  }
+
+  bool registerFiles(const int *fds, unsigned count) {
+    return ::syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_FILES,
+                     fds, count) == 0;
+  }
+
+  // Queues and submits a write of a registered buffer to registered file 0.
+  // Returns false, if the write is not in flight; the entry is taken back
+  // then.
+  bool submitWriteFixed(const char *data, std::size_t len,
+                        std::uint64_t offset, unsigned bufferIndex,
+                        std::uint64_t userData) {
+    const unsigned tail = *m_sqTail;
+    if (tail - std::atomic_ref{*m_sqHead}.load(std::memory_order_acquire) >=
+        m_sqEntries)
+      return false;
+
+    const unsigned index = tail & m_sqMask;
+    io_uring_sqe &sqe = m_sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_WRITE_FIXED;
+    sqe.flags = IOSQE_FIXED_FILE;
+    sqe.fd = 0;
+    sqe.addr = reinterpret_cast<std::uint64_t>(data);
+    sqe.len = static_cast<std::uint32_t>(len);
+    sqe.off = offset;
+    sqe.buf_index = static_cast<std::uint16_t>(bufferIndex);
+    sqe.user_data = userData;
+    m_sqArray[index] = index;
+    std::atomic_ref{*m_sqTail}.store(tail + 1, std::memory_order_release);
+
+    int rc;
+    do {
+      rc = enter(1, 0, 0);
+    } while (rc < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+    // The kernel consumes entries only within enter(). One it left in the
+    // ring would go out with the next submission, after the caller wrote the
+    // data by other means, and its completion would be awaited.
+    if (std::atomic_ref{*m_sqHead}.load(std::memory_order_acquire) == tail) {
+      std::atomic_ref{*m_sqTail}.store(tail, std::memory_order_release);
+      return false;
+    }
+    return true;
+  }
+
+  // Blocks until a completion is available and consumes it.
+  bool waitCompletion(UringCompletion &completion) {
+    for (;;) {
+      if (peekCompletion(completion))
+        return true;
+      if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        return false;
+    }
+  }
+
+  bool peekCompletion(UringCompletion &completion) {
+    const unsigned head = *m_cqHead;
+    if (head == std::atomic_ref{*m_cqTail}.load(std::memory_order_acquire))
+      return false;
+    const io_uring_cqe &cqe = m_cqes[head & m_cqMask];
+    completion = {cqe.user_data, cqe.res};
+    std::atomic_ref{*m_cqHead}.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  void close() {
+    if (m_sqes != nullptr)
+      ::munmap(m_sqes, m_sqesSize);
+    if (m_ring != nullptr)
+      ::munmap(m_ring, m_ringSize);
+    if (m_ringFd != -1)
+      ::close(m_ringFd);
+    m_sqes = nullptr;
+    m_ring = nullptr;
+    m_ringFd = -1;
+  }
+
+private:
+  int enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, m_ringFd, toSubmit,
+                                      minComplete, flags, nullptr, 0));
+  }
+
+  int m_ringFd{-1};
+  void *m_ring{nullptr};
+  std::size_t m_ringSize{0};
+  io_uring_sqe *m_sqes{nullptr};
+  std::size_t m_sqesSize{0};
+
+  unsigned *m_sqHead{nullptr};
+  unsigned *m_sqTail{nullptr};
+  unsigned *m_sqArray{nullptr};
+  unsigned m_sqMask{0};
+  unsigned m_sqEntries{0};
+  unsigned *m_cqHead{nullptr};
+  unsigned *m_cqTail{nullptr};
+  unsigned m_cqMask{0};
+  io_uring_cqe *m_cqes{nullptr};
+};
+
+} // namespace lfy::details
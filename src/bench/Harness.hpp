@@ -0,0 +1,276 @@
+// Minimal microbenchmark harness in the style of Google Benchmark, so the
+// benchmarks build without dependencies:
+//
+//   void BM_info(lfy::bench::State &state) {
+//     for (auto _ : state)
+//       logger->info("value {}", 42);
+//   }
+//   lfy::bench::add("log/info", BM_info).threads({1, 2, 4});
+//   return lfy::bench::run(argc, argv);
+//
+// Each benchmark is calibrated to run for --min-time seconds and then
+// repeated --repetitions times. Reported are the median and the minimum time
+// per iteration of one thread, the coefficient of variation of the
+// repetitions and the throughput of all threads together. Compare medians;
+// a high CV marks a noisy result.
+
+#pragma once
+
+#include <algorithm>
+#include <barrier>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace lfy::bench {
+
+// Keeps the compiler from optimizing away the computation of value.
+template <typename T> inline void doNotOptimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class State {
+public:
+  State(std::uint64_t iterations, std::size_t threads, std::size_t threadIndex)
+      : m_iterations{iterations}, m_threads{threads},
+        m_threadIndex{threadIndex} {}
+
+  // Type of the loop variable, which is never used.
+  struct [[maybe_unused]] Value {};
+
+  struct Iterator {
+    std::uint64_t remaining;
+    State *state;
+
+    bool operator!=(const Iterator &) {
+      if (remaining != 0)
+        return true;
+      state->m_stop = std::chrono::steady_clock::now();
+      return false;
+    }
+    void operator++() { --remaining; }
+    Value operator*() const { return {}; }
+  };
+
+  // The timed loop starts with begin() and ends with the last iteration.
+  Iterator begin() {
+    m_start = std::chrono::steady_clock::now();
+    return {m_iterations, this};
+  }
+  Iterator end() { return {0, this}; }
+
+  [[nodiscard]] std::uint64_t iterations() const { return m_iterations; }
+  [[nodiscard]] std::size_t threads() const { return m_threads; }
+  [[nodiscard]] std::size_t threadIndex() const { return m_threadIndex; }
+
+  [[nodiscard]] std::chrono::steady_clock::time_point startTime() const {
+    return m_start;
+  }
+  [[nodiscard]] std::chrono::steady_clock::time_point stopTime() const {
+    return m_stop;
+  }
+
+private:
+  std::uint64_t m_iterations;
+  std::size_t m_threads;
+  std::size_t m_threadIndex;
+  std::chrono::steady_clock::time_point m_start{};
+  std::chrono::steady_clock::time_point m_stop{};
+};
+
+using Function = std::function<void(State &)>;
+
+struct Benchmark {
+  // Runs the benchmark once for each thread count.
+  Benchmark &threads(std::vector<std::size_t> counts) {
+    m_threadCounts = std::move(counts);
+    return *this;
+  }
+
+  // Called before and after all runs of each thread count, untimed.
+  Benchmark &setup(std::function<void(std::size_t threads)> fn) {
+    m_setup = std::move(fn);
+    return *this;
+  }
+  Benchmark &teardown(std::function<void(std::size_t threads)> fn) {
+    m_teardown = std::move(fn);
+    return *this;
+  }
+
+  std::string m_name;
+  Function m_function;
+  std::vector<std::size_t> m_threadCounts{1};
+  std::function<void(std::size_t)> m_setup{};
+  std::function<void(std::size_t)> m_teardown{};
+};
+
+namespace details {
+
+inline std::vector<Benchmark> &registry() {
+  static std::vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+// Nanoseconds per iteration of one thread, from the first thread starting to
+// the last one finishing.
+inline double run_once(const Function &fn, std::size_t threads,
+                       std::uint64_t iterations) {
+  std::vector<State> states;
+  states.reserve(threads);
+  for (std::size_t i = 0; i < threads; ++i)
+    states.emplace_back(iterations, threads, i);
+
+  if (threads == 1) {
+    fn(states[0]);
+  } else {
+    std::barrier start(static_cast<std::ptrdiff_t>(threads));
+    std::vector<std::thread> workers;
+    for (State &state : states)
+      workers.emplace_back([&fn, &start, &state] {
+        start.arrive_and_wait();
+        fn(state);
+      });
+    for (std::thread &worker : workers)
+      worker.join();
+  }
+
+  auto first = states[0].startTime();
+  auto last = states[0].stopTime();
+  for (const State &state : states) {
+    first = std::min(first, state.startTime());
+    last = std::max(last, state.stopTime());
+  }
+  return std::chrono::duration<double, std::nano>(last - first).count() /
+         static_cast<double>(iterations);
+}
+
+struct Options {
+  double minTime{0.1};
+  std::size_t repetitions{5};
+  std::string filter;
+  bool csv{false};
+};
+
+inline bool parse_options(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view name) {
+      return arg.substr(0, name.size()) == name ? arg.substr(name.size())
+                                                : std::string_view{};
+    };
+    if (auto v = value("--min-time="); !v.empty())
+      options.minTime = std::atof(std::string(v).c_str());
+    else if (auto v = value("--repetitions="); !v.empty())
+      options.repetitions = std::max(1, std::atoi(std::string(v).c_str()));
+    else if (auto v = value("--filter="); !v.empty())
+      options.filter = v;
+    else if (arg == "--csv")
+      options.csv = true;
+    else
+      return false;
+  }
+  return true;
+}
+
+} // namespace details
+
+// Registers a benchmark, to be run by run() in the order of registration.
+inline Benchmark &add(std::string name, Function fn) {
+  details::registry().push_back(Benchmark{std::move(name), std::move(fn)});
+  return details::registry().back();
+}
+
+// Runs all benchmarks whose name contains --filter and prints one line per
+// benchmark and thread count. Returns the exit code for main.
+inline int run(int argc, char **argv) {
+  details::Options options;
+  if (!details::parse_options(argc, argv, options)) {
+    std::fprintf(stderr,
+                 "usage: %s [--filter=<substring>] [--min-time=<seconds>] "
+                 "[--repetitions=<n>] [--csv]\n",
+                 argv[0]);
+    return 2;
+  }
+
+  if (options.csv)
+    std::printf("name,threads,iterations,median_ns,min_ns,cv_percent,"
+                "items_per_second\n");
+  else
+    std::printf("%-40s %12s %10s %10s %6s %14s\n", "benchmark", "iterations",
+                "median ns", "min ns", "cv %", "items/s");
+
+  for (const Benchmark &benchmark : details::registry()) {
+    if (benchmark.m_name.find(options.filter) == std::string::npos)
+      continue;
+    for (const std::size_t threads : benchmark.m_threadCounts) {
+      const std::string name =
+          benchmark.m_name + "/threads:" + std::to_string(threads);
+      try {
+        if (benchmark.m_setup)
+          benchmark.m_setup(threads);
+      } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s skipped: %s\n", name.c_str(), e.what());
+        continue;
+      }
+
+      // Grow the iteration count until a run takes a tenth of the minimum
+      // time, then extrapolate to the minimum time.
+      std::uint64_t iterations = 1;
+      double nanoseconds = 0;
+      while (true) {
+        nanoseconds = details::run_once(benchmark.m_function, threads,
+                                        iterations);
+        const double total = nanoseconds * static_cast<double>(iterations);
+        if (total >= options.minTime * 1e8 || iterations >= 1'000'000'000)
+          break;
+        iterations *= 10;
+      }
+      iterations = std::max<std::uint64_t>(
+          1, static_cast<std::uint64_t>(options.minTime * 1e9 /
+                                        std::max(nanoseconds, 1e-3)));
+
+      std::vector<double> samples;
+      for (std::size_t r = 0; r < options.repetitions; ++r)
+        samples.push_back(
+            details::run_once(benchmark.m_function, threads, iterations));
+      if (benchmark.m_teardown)
+        benchmark.m_teardown(threads);
+
+      std::sort(samples.begin(), samples.end());
+      const double median = samples[samples.size() / 2];
+      double mean = 0;
+      for (const double sample : samples)
+        mean += sample / static_cast<double>(samples.size());
+      double variance = 0;
+      for (const double sample : samples)
+        variance += (sample - mean) * (sample - mean) /
+                    static_cast<double>(samples.size());
+      const double cv = mean > 0 ? 100 * std::sqrt(variance) / mean : 0;
+      const double itemsPerSecond =
+          static_cast<double>(threads) * 1e9 / median;
+
+      if (options.csv)
+        std::printf("%s,%zu,%llu,%.1f,%.1f,%.1f,%.0f\n", name.c_str(), threads,
+                    static_cast<unsigned long long>(iterations), median,
+                    samples.front(), cv, itemsPerSecond);
+      else
+        std::printf("%-40s %12llu %10.1f %10.1f %6.1f %14.0f\n", name.c_str(),
+                    static_cast<unsigned long long>(iterations), median,
+                    samples.front(), cv, itemsPerSecond);
+      std::fflush(stdout);
+    }
+  }
+  return 0;
+}
+
+} // namespace lfy::bench
@@ -0,0 +1,343 @@
+// Allocation accounting: replaces the global operator new and the malloc
+// family with counting versions and checks how often each logging path
+// allocates in steady state, i.e. after caches and buffers are warmed up.
+//
+//   lfy_alloc [--iterations=<n>]
+//
+// Prints one line per path and exits with 1 if any path allocates more or
+// less often than expected, so a change which adds an allocation to a hot
+// path fails loudly. Only allocations of the calling thread are counted;
+// background threads of outputters are not on the path of the caller.
+//
+// Zero allocation configuration, enforced by the logger/* checks: once a
+// thread logged a record of the usual size, a logging call does not allocate
+// if
+//   - the logger is held (a std::shared_ptr or a LoggerRef from
+//     Repository::getLoggerRef or LFY_LOGGER); getLogger with a string
+//     literal constructs a std::string
+//   - headers are generated by headergen::Level, LoggerName or Time; Time
+//     refreshes its cached time stamp in place once per second and allocates
+//     only for its first record per thread or after the time zone changed
+//   - the arguments are formatted without allocating, e.g. numbers and
+//     string views
+//   - the outputters are File, Console, MappedFile, DirectFile, UringFile or
+//     CompressedFile, optionally behind Dedup, with any flusher
+// LogFormatter::format returns a new std::string and allocates once.
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "lfy/CompressedOutputter.hpp"
+#include "lfy/DedupOutputter.hpp"
+#include "lfy/DirectOutputter.hpp"
+#include "lfy/HeaderGen.hpp"
+#include "lfy/Logger.hpp"
+#include "lfy/MappedOutputter.hpp"
+#include "lfy/Outputter.hpp"
+#include "lfy/Repository.hpp"
+#include "lfy/UringOutputter.hpp"
+
+namespace {
+
+// Allocations of the calling thread. Plain thread locals of the executable,
+// which are safe to use from within malloc.
+thread_local std::uint64_t allocations{0}; // All of the malloc family
+thread_local std::uint64_t news{0};        // operator new, a subset
+
+} // namespace
+
+extern "C" {
+
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *pointer, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void *pointer);
+
+void *malloc(std::size_t size) {
+  ++allocations;
+  return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size) {
+  ++allocations;
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, std::size_t size) {
+  ++allocations;
+  return __libc_realloc(pointer, size);
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size) {
+  ++allocations;
+  return __libc_memalign(alignment, size);
+}
+
+void *memalign(std::size_t alignment, std::size_t size) {
+  ++allocations;
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, std::size_t alignment, std::size_t size) {
+  ++allocations;
+  // *pointer is left alone on failure, as posix_memalign specifies.
+  void *allocated = __libc_memalign(alignment, size);
+  if (allocated == nullptr)
+    return ENOMEM;
+  *pointer = allocated;
+  return 0;
+}
+
+void free(void *pointer) { __libc_free(pointer); }
+
+} // extern "C"
+
+// The other forms of new and delete of the standard library forward to these.
+void *operator new(std::size_t size) {
+  ++news;
+  if (void *pointer = std::malloc(size != 0 ? size : 1))
+    return pointer;
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  ++news;
+  if (void *pointer = ::memalign(static_cast<std::size_t>(alignment),
+                                 size != 0 ? size : 1))
+    return pointer;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+
+void operator delete(void *pointer, std::size_t) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+
+namespace {
+
+using namespace lfy;
+using namespace lfy::literals;
+
+struct Check {
+  std::string name;
+  std::uint64_t expected; // Allocations per call
+  std::function<void()> call;
+};
+
+struct Options {
+  // Checks which run longer than a second also cover the refresh of the
+  // time stamp of headergen::Time, e.g. with --iterations=1000000.
+  std::size_t iterations{100'000};
+};
+
+std::filesystem::path directory() {
+  static const std::filesystem::path path = [] {
+    auto p = std::filesystem::temp_directory_path() /
+             ("lfy_alloc_" + std::to_string(::getpid()));
+    std::filesystem::create_directories(p);
+    return p;
+  }();
+  return path;
+}
+
+// A record of the usual size, too long for the small string optimization.
+const std::string &message() {
+  static const std::string text(99, 'x');
+  return text;
+}
+
+void addOutputter(std::vector<Check> &checks, std::string name,
+                  std::shared_ptr<Outputter> outputter) {
+  checks.push_back({"outputter/" + name, 0, [outputter] {
+                      outputter->output(message());
+                    }});
+}
+
+// Logs through a logger with the given outputter, Time and Level headers and
+// a flusher.
+void addLogger(std::vector<Check> &checks, std::string name,
+               std::shared_ptr<Outputter> outputter,
+               Flusher flusher = flushers::Automatic()) {
+  const std::string path = "alloc." + name;
+  LoggerSettings settings;
+  settings.m_outputters.push_back(OutputterAttachment{std::move(outputter)});
+  settings.m_headerGenerators.push_back(headergen::Time());
+  settings.m_headerGenerators.push_back(headergen::Level());
+  settings.m_flushApplier = std::move(flusher);
+  Repository::configure({{path, std::move(settings)}});
+  auto logger = Repository::getLogger(path, Inheritance::Enabled);
+  checks.push_back({"logger/" + name, 0, [logger] {
+                      logger->info("request {} took {} us on {}", 42, 1.5,
+                                   std::string_view{"worker"});
+                    }});
+}
+
+std::vector<Check> checks() {
+  std::vector<Check> checks;
+
+  // Formatting into a new string, reserved up front
+  static const std::string loggerName = "alloc.format";
+  static const LogMetaData metaData{loggerName, LogLevel::Info};
+  static const std::vector<HeaderGenerator> noHeaders;
+  static const std::vector<HeaderGenerator> headers{headergen::Time(),
+                                                    headergen::Level()};
+  static const LogFormatter formatter;
+  checks.push_back({"format/plain", 1, [] {
+                      std::string text = formatter.format(
+                          metaData, noHeaders,
+                          "connection to the upstream server established");
+                    }});
+  checks.push_back({"format/args", 1, [] {
+                      std::string text = formatter.format(
+                          metaData, noHeaders, "request {} took {} us", 42,
+                          1.5);
+                    }});
+  checks.push_back({"format/headers", 1, [] {
+                      std::string text = formatter.format(
+                          metaData, headers, "request {} took {} us", 42,
+                          1.5);
+                    }});
+
+  // Header generators appending to a string with enough capacity; the time
+  // stamp of metaData stays the same, so Time is served from its cache.
+  static std::string buffer;
+  buffer.reserve(256);
+  auto addHeader = [&checks](std::string name, HeaderGenerator generator) {
+    checks.push_back({"header/" + name, 0, [generator] {
+                        buffer.clear();
+                        generator(metaData, buffer);
+                      }});
+  };
+  addHeader("level", headergen::Level());
+  addHeader("logger_name", headergen::LoggerName());
+  addHeader("time_local", headergen::Time(TimeType::Local));
+  addHeader("time_utc", headergen::Time(TimeType::Utc));
+
+  // Looking up existing loggers
+  Repository::getLogger("alloc");
+  static const std::string inherited = "alloc.inherited.logger";
+  Repository::getLogger(inherited, Inheritance::Enabled);
+  checks.push_back({"getLogger/inherited", 0, [] {
+                      Repository::getLogger(inherited, Inheritance::Enabled);
+                    }});
+  checks.push_back({"getLogger/literal", 1, [] {
+                      Repository::getLogger("alloc.inherited.logger",
+                                            Inheritance::Enabled);
+                    }});
+  checks.push_back({"getLoggerRef/inherited", 0, [] {
+                      Repository::getLoggerRef("alloc.inherited.logger",
+                                               Inheritance::Enabled);
+                    }});
+
+  addOutputter(checks, "console", outputters::Console());
+  addOutputter(checks, "file_4k",
+               outputters::File(directory() / "file_4k",
+                                BufferCapacity<4_KiB>{}));
+  addOutputter(checks, "file_64k", outputters::File(directory() / "file_64k"));
+  addOutputter(checks, "mapped",
+               outputters::MappedFile(directory() / "mapped"));
+  addOutputter(checks, "direct",
+               outputters::DirectFile(directory() / "direct"));
+  addOutputter(checks, "uring", outputters::UringFile(directory() / "uring"));
+  addOutputter(checks, "compressed",
+               outputters::CompressedFile(directory() / "compressed"));
+  addOutputter(checks, "dedup",
+               outputters::Dedup(outputters::File(directory() / "dedup")));
+
+  addLogger(checks, "file", outputters::File(directory() / "logger_file"));
+  addLogger(checks, "file_always",
+            outputters::File(directory() / "logger_file_always"),
+            flushers::Always());
+  addLogger(checks, "mapped",
+            outputters::MappedFile(directory() / "logger_mapped"));
+  addLogger(checks, "compressed",
+            outputters::CompressedFile(directory() / "logger_compressed"));
+  addLogger(checks, "dedup",
+            outputters::Dedup(
+                outputters::File(directory() / "logger_dedup")));
+  return checks;
+}
+
+bool parse(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const std::string_view name = "--iterations=";
+    if (arg.substr(0, name.size()) != name)
+      return false;
+    options.iterations = static_cast<std::size_t>(
+        std::atoi(std::string(arg.substr(name.size())).c_str()));
+  }
+  return options.iterations > 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse(argc, argv, options)) {
+    std::fprintf(stderr, "usage: %s [--iterations=<n>]\n", argv[0]);
+    return 2;
+  }
+
+  // Standard output is kept for the report, the console outputter writes to
+  // /dev/null.
+  const int report = ::dup(STDOUT_FILENO);
+  const int null = ::open("/dev/null", O_WRONLY);
+  ::dup2(null, STDOUT_FILENO);
+  ::close(null);
+  std::FILE *out = ::fdopen(report, "w");
+
+  std::fprintf(out, "%-28s %10s %12s %12s %12s\n", "path", "per call",
+               "calls", "allocations", "new");
+  bool failed = false;
+  {
+    const std::vector<Check> all = checks();
+    for (const Check &check : all) {
+      // Warm up: caches, buffers which grow once and at least one flush of
+      // the larger outputter buffers
+      for (std::size_t i = 0; i < options.iterations; ++i)
+        check.call();
+
+      const std::uint64_t allocationsBefore = allocations;
+      const std::uint64_t newsBefore = news;
+      for (std::size_t i = 0; i < options.iterations; ++i)
+        check.call();
+      const std::uint64_t measured = allocations - allocationsBefore;
+      const bool ok = measured == check.expected * options.iterations;
+      failed = failed || !ok;
+      std::fprintf(out, "%-28s %10llu %12zu %12llu %12llu%s\n",
+                   check.name.c_str(),
+                   static_cast<unsigned long long>(check.expected),
+                   options.iterations,
+                   static_cast<unsigned long long>(measured),
+                   static_cast<unsigned long long>(news - newsBefore),
+                   ok ? "" : "  FAILED");
+    }
+  }
+  std::filesystem::remove_all(directory());
+  std::fclose(out);
+  return failed ? 1 : 0;
+}
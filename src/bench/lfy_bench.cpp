@@ -0,0 +1,286 @@
+// Microbenchmarks of the logging pipeline:
+//
+//   lfy_bench [--filter=<substring>] [--min-time=<seconds>] [--csv]
+//
+// log/<level>/{enabled,filtered}  Per call cost of a logger without headers
+//                                 into a sink which discards the records.
+// header/<generator>              Header generators, appending to a string.
+// format/args:<n>                 LogFormatter::format with n arguments.
+// outputter/<type>                Outputter::output of a 100 byte record.
+// shared/<sink>                   Threads logging through one logger.
+// repository/create_child         Creating an inheriting logger under a
+//                                 parent, which keeps all loggers created so
+//                                 far as children, i.e. 10k and more.
+//
+// Files are written to a temporary directory, which is removed at exit.
+
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Harness.hpp"
+#include "lfy/CompressedOutputter.hpp"
+#include "lfy/DedupOutputter.hpp"
+#include "lfy/DirectOutputter.hpp"
+#include "lfy/HeaderGen.hpp"
+#include "lfy/Logger.hpp"
+#include "lfy/MappedOutputter.hpp"
+#include "lfy/Outputter.hpp"
+#include "lfy/Repository.hpp"
+#include "lfy/UringOutputter.hpp"
+
+namespace {
+
+using namespace lfy;
+using namespace lfy::literals;
+using bench::State;
+
+// Discards all records, isolating the cost of the logger.
+class NullOutputter : public Outputter {
+public:
+  void output(const std::string &message) override {
+    bench::doNotOptimize(message.data());
+  }
+  std::chrono::steady_clock::time_point lastFlush() override {
+    return std::chrono::steady_clock::now();
+  }
+  void flush() override {}
+};
+
+std::filesystem::path directory() {
+  static const std::filesystem::path path = [] {
+    auto p = std::filesystem::temp_directory_path() /
+             ("lfy_bench_" + std::to_string(::getpid()));
+    std::filesystem::create_directories(p);
+    return p;
+  }();
+  return path;
+}
+
+std::shared_ptr<Logger> nullLogger(const std::string &name, LogLevel level) {
+  auto logger = Repository::getLogger(name);
+  logger->addOutputter(std::make_shared<NullOutputter>());
+  logger->setLogLevel(level);
+  return logger;
+}
+
+template <LogLevel Level> void logAt(Logger &logger) {
+  if constexpr (Level == LogLevel::Debug)
+    logger.debug("request {} took {} us", 42, 1.5);
+  else if constexpr (Level == LogLevel::Info)
+    logger.info("request {} took {} us", 42, 1.5);
+  else if constexpr (Level == LogLevel::Warn)
+    logger.warn("request {} took {} us", 42, 1.5);
+  else
+    logger.error("request {} took {} us", 42, 1.5);
+}
+
+template <LogLevel Level> void addLevel(std::string_view name) {
+  auto enabled = nullLogger(std::format("bench.{}.enabled", name), Level);
+  bench::add(std::format("log/{}/enabled", name),
+             [enabled](State &state) {
+               for (auto _ : state)
+                 logAt<Level>(*enabled);
+             });
+  auto filtered =
+      nullLogger(std::format("bench.{}.filtered", name), LogLevel::Error);
+  if constexpr (Level != LogLevel::Error) {
+    bench::add(std::format("log/{}/filtered", name),
+               [filtered](State &state) {
+                 for (auto _ : state)
+                   logAt<Level>(*filtered);
+               });
+  }
+}
+
+void addHeader(std::string name, HeaderGenerator generator) {
+  bench::add("header/" + name, [generator](State &state) {
+    static const std::string loggerName = "bench.header";
+    std::string buffer;
+    for (auto _ : state) {
+      buffer.clear();
+      generator(LogMetaData{loggerName, LogLevel::Info}, buffer);
+      bench::doNotOptimize(buffer.data());
+    }
+  });
+}
+
+template <std::size_t N> void addFormat() {
+  bench::add(std::format("format/args:{}", N), [](State &state) {
+    static const std::string loggerName = "bench.format";
+    const std::vector<HeaderGenerator> headers;
+    const LogFormatter formatter;
+    const LogMetaData metaData{loggerName, LogLevel::Info};
+    for (auto _ : state) {
+      std::string message;
+      if constexpr (N == 0)
+        message = formatter.format(metaData, headers, "a plain message");
+      else if constexpr (N == 1)
+        message = formatter.format(metaData, headers, "{}", 1);
+      else if constexpr (N == 2)
+        message = formatter.format(metaData, headers, "{} {}", 1, 2);
+      else if constexpr (N == 3)
+        message = formatter.format(metaData, headers, "{} {} {}", 1, 2, 3);
+      else if constexpr (N == 4)
+        message =
+            formatter.format(metaData, headers, "{} {} {} {}", 1, 2, 3, 4);
+      else if constexpr (N == 5)
+        message = formatter.format(metaData, headers, "{} {} {} {} {}", 1, 2,
+                                   3, 4, 5);
+      else if constexpr (N == 6)
+        message = formatter.format(metaData, headers, "{} {} {} {} {} {}", 1,
+                                   2, 3, 4, 5, 6);
+      else if constexpr (N == 7)
+        message = formatter.format(metaData, headers, "{} {} {} {} {} {} {}",
+                                   1, 2, 3, 4, 5, 6, 7);
+      else
+        message = formatter.format(metaData, headers,
+                                   "{} {} {} {} {} {} {} {}", 1, 2, 3, 4, 5,
+                                   6, 7, 8);
+      bench::doNotOptimize(message.data());
+    }
+  });
+}
+
+template <std::size_t... N> void addFormats(std::index_sequence<N...>) {
+  (addFormat<N>(), ...);
+}
+
+// Benchmarks an outputter, created before and destroyed after all runs. The
+// records are flushed after each timed loop. after runs once the outputter
+// is gone.
+void addOutputter(std::string name,
+                  std::function<std::shared_ptr<Outputter>()> create,
+                  std::function<void()> after = {}) {
+  auto outputter = std::make_shared<std::shared_ptr<Outputter>>();
+  bench::add("outputter/" + name,
+             [outputter](State &state) {
+               const std::string message(99, 'x');
+               for (auto _ : state)
+                 (*outputter)->output(message);
+               (*outputter)->flush();
+             })
+      .setup([outputter, create](std::size_t) { *outputter = create(); })
+      .teardown([outputter, name, after](std::size_t) {
+        outputter->reset();
+        std::filesystem::remove(directory() / name);
+        if (after)
+          after();
+      });
+}
+
+// Standard output is redirected to /dev/null while the console outputter
+// exists, to keep the report readable.
+void addConsole() {
+  auto saved = std::make_shared<int>(-1);
+  addOutputter(
+      "console",
+      [saved] {
+        std::fflush(stdout);
+        *saved = ::dup(STDOUT_FILENO);
+        const int null = ::open("/dev/null", O_WRONLY);
+        ::dup2(null, STDOUT_FILENO);
+        ::close(null);
+        return outputters::Console();
+      },
+      [saved] {
+        std::fflush(stdout);
+        ::dup2(*saved, STDOUT_FILENO);
+        ::close(*saved);
+      });
+}
+
+// Threads log through one logger, which writes to a shared sink.
+void addShared(std::string name,
+               std::function<std::shared_ptr<Outputter>()> create) {
+  const std::string path = "bench.shared." + name;
+  auto logger = Repository::getLogger(path, Inheritance::Enabled);
+  bench::add("shared/" + name,
+             [logger](State &state) {
+               for (auto _ : state)
+                 logger->info("request {} took {} us", state.threadIndex(),
+                              1.5);
+               if (state.threadIndex() == 0)
+                 for (const auto &outputter : logger->getOutputters())
+                   outputter->flush();
+             })
+      .threads({1, 2, 4, 8, 16, 32, 64})
+      .setup([path, create](std::size_t) {
+        LoggerSettings settings;
+        settings.m_outputters.push_back(OutputterAttachment{create()});
+        settings.m_headerGenerators.push_back(headergen::Level());
+        Repository::configure({{path, std::move(settings)}});
+      })
+      .teardown([path, name](std::size_t) {
+        Repository::configure({{path, LoggerSettings{}}});
+        std::filesystem::remove(directory() / name);
+      });
+}
+
+// Each iteration adds one more child to the same parent.
+void addCreateChild() {
+  Repository::getLogger("bench.fanout", Inheritance::Enabled);
+  bench::add("repository/create_child", [](State &state) {
+    static std::size_t created = 0;
+    for (auto _ : state)
+      bench::doNotOptimize(Repository::getLogger(
+          std::format("bench.fanout.{}", created++), Inheritance::Enabled));
+  });
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  addLevel<LogLevel::Debug>("debug");
+  addLevel<LogLevel::Info>("info");
+  addLevel<LogLevel::Warn>("warn");
+  addLevel<LogLevel::Error>("error");
+
+  addHeader("level", headergen::Level());
+  addHeader("logger_name", headergen::LoggerName());
+  addHeader("time_local", headergen::Time(TimeType::Local));
+  addHeader("time_utc", headergen::Time(TimeType::Utc));
+
+  addFormats(std::make_index_sequence<9>{});
+
+  addOutputter("null", [] { return std::make_shared<NullOutputter>(); });
+  addConsole();
+  addOutputter("file_4k", [] {
+    return outputters::File(directory() / "file_4k", BufferCapacity<4_KiB>{});
+  });
+  addOutputter("file_64k", [] {
+    return outputters::File(directory() / "file_64k",
+                            BufferCapacity<64_KiB>{});
+  });
+  addOutputter("compressed", [] {
+    return outputters::CompressedFile(directory() / "compressed");
+  });
+  addOutputter("mapped",
+               [] { return outputters::MappedFile(directory() / "mapped"); });
+  addOutputter("direct",
+               [] { return outputters::DirectFile(directory() / "direct"); });
+  addOutputter("uring",
+               [] { return outputters::UringFile(directory() / "uring"); });
+  addOutputter("dedup", [] {
+    return outputters::Dedup(std::make_shared<NullOutputter>());
+  });
+
+  addShared("null", [] { return std::make_shared<NullOutputter>(); });
+  addShared("file_64k", [] {
+    return outputters::File(directory() / "file_64k",
+                            BufferCapacity<64_KiB>{});
+  });
+
+  addCreateChild();
+
+  const int result = bench::run(argc, argv);
+  std::filesystem::remove_all(directory());
+  return result;
+}
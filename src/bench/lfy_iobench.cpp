@@ -0,0 +1,380 @@
+// End-to-end I/O benchmark of FileOutputter against a real filesystem, to
+// choose buffer sizes and flushers from data:
+//
+//   lfy_iobench [--directory=<path>] [--megabytes=<n>] [--threads=<n>]
+//               [--sync-every=<records>] [--filter=<substring>]
+//               [--csv=<file>]
+//
+// Producers log records as fast as they can through one logger, for every
+// combination of
+//   buffer   FileOutputter<N> with N from 4 KiB to 1 MiB
+//   flusher  each of flushers::, EveryNthMessage with 100 records
+//   sync     nosync, or fsync: every --sync-every-th record is logged at the
+//            durable level, so the call waits for fdatasync
+//   disk     idle, or busy: a background thread rewrites a 256 MiB file with
+//            fdatasync after every 8 MiB, competing for the device
+//
+// Reported are the throughput from the first record until all data reached
+// the operating system, write system calls per MiB as counted by
+// details::write_bytes, and the time producers stalled: the sum and the
+// maximum of all log calls which took longer than StallThreshold, as copying
+// a record into the buffer takes far less. A preempted producer stalls as
+// well, so use fewer threads than cores. Files are written to --directory,
+// the current directory by default since the temporary directory is often a
+// tmpfs; they are removed at exit.
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "lfy/HeaderGen.hpp"
+#include "lfy/Logger.hpp"
+#include "lfy/Outputter.hpp"
+#include "lfy/Repository.hpp"
+
+namespace {
+
+using namespace lfy;
+using namespace lfy::literals;
+using Clock = std::chrono::steady_clock;
+
+constexpr auto StallThreshold = std::chrono::microseconds(20);
+
+struct Options {
+  std::filesystem::path directory{std::filesystem::current_path()};
+  std::size_t megabytes{32};
+  std::size_t threads{2};
+  std::size_t syncEvery{100};
+  std::string filter;
+  std::string csv;
+};
+
+struct Buffer {
+  std::string name;
+  std::function<std::shared_ptr<Outputter>(const std::filesystem::path &)>
+      create;
+};
+
+struct FlushPolicy {
+  std::string name;
+  std::function<Flusher()> create; // Stateful flushers need a fresh copy
+};
+
+struct Configuration {
+  const Buffer *buffer;
+  const FlushPolicy *flusher;
+  bool fsync;
+  bool busy;
+
+  [[nodiscard]] std::string name() const {
+    return buffer->name + "/" + flusher->name + "/" +
+           (fsync ? "fsync" : "nosync") + "/" + (busy ? "busy" : "idle");
+  }
+};
+
+struct Result {
+  double seconds{0};
+  OutputterMetrics metrics;
+  std::uint64_t stalls{0};
+  Clock::duration stalled{};
+  Clock::duration maxStall{};
+  double busyMegabytesPerSecond{0};
+};
+
+template <std::size_t N> Buffer file(std::string name) {
+  return {std::move(name), [](const std::filesystem::path &path) {
+            return std::shared_ptr<Outputter>(
+                outputters::File(path, BufferCapacity<N>{}));
+          }};
+}
+
+std::vector<Buffer> buffers() {
+  return {file<4_KiB>("file_4k"),     file<16_KiB>("file_16k"),
+          file<64_KiB>("file_64k"),   file<256_KiB>("file_256k"),
+          file<1_MiB>("file_1m")};
+}
+
+std::vector<FlushPolicy> flushPolicies() {
+  return {{"automatic", [] { return Flusher(flushers::Automatic()); }},
+          {"every_100", [] { return Flusher(flushers::EveryNthMessage(100)); }},
+          {"lazy_timed_1s", [] { return Flusher(flushers::LazyTimed()); }},
+          {"always", [] { return Flusher(flushers::Always()); }}};
+}
+
+// Competes for the device: rewrites a file in 1 MiB blocks and forces them
+// out every 8 MiB, until destroyed.
+class BusyDisk {
+public:
+  explicit BusyDisk(const std::filesystem::path &path) : m_path{path} {
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    if (m_fd == -1)
+      throw std::runtime_error("BusyDisk: cannot open " + path.string());
+    m_thread = std::jthread([this](std::stop_token stop) { run(stop); });
+  }
+
+  ~BusyDisk() {
+    m_thread.request_stop();
+    m_thread.join();
+    ::close(m_fd);
+    std::filesystem::remove(m_path);
+  }
+
+  [[nodiscard]] std::uint64_t written() const {
+    return m_written.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr std::size_t Block = 1_MiB;
+  static constexpr std::size_t Extent = 256_MiB;
+
+  void run(std::stop_token stop) {
+    const std::vector<char> block(Block, 'b');
+    std::size_t offset = 0;
+    while (!stop.stop_requested()) {
+      if (::pwrite(m_fd, block.data(), Block, static_cast<off_t>(offset)) !=
+          static_cast<ssize_t>(Block))
+        return;
+      m_written.fetch_add(Block, std::memory_order_relaxed);
+      offset = (offset + Block) % Extent;
+      if (offset % (8 * Block) == 0)
+        ::fdatasync(m_fd);
+    }
+  }
+
+  std::filesystem::path m_path;
+  int m_fd{-1};
+  std::atomic<std::uint64_t> m_written{0};
+  std::jthread m_thread;
+};
+
+// Stall statistics of one producer.
+struct Stalls {
+  std::uint64_t count{0};
+  Clock::duration total{};
+  Clock::duration max{};
+};
+
+void produce(Logger &logger, std::size_t index, std::uint64_t records,
+             std::size_t syncEvery, std::barrier<> &start, Stalls &stalls) {
+  start.arrive_and_wait();
+  for (std::uint64_t i = 1; i <= records; ++i) {
+    const Clock::time_point before = Clock::now();
+    if (syncEvery != 0 && i % syncEvery == 0)
+      logger.warn("checkpoint {} of producer {} committed, {} records behind "
+                  "the head of the queue",
+                  i, index, records - i);
+    else
+      logger.info("request {} of producer {} served in {} us with status {} "
+                  "and {} bytes of payload",
+                  i, index, 42, 200, 1234);
+    const Clock::duration took = Clock::now() - before;
+    if (took > StallThreshold) {
+      ++stalls.count;
+      stalls.total += took;
+      stalls.max = std::max(stalls.max, took);
+    }
+  }
+}
+
+Result measure(const Configuration &configuration, const Options &options) {
+  const std::string path = "iobench";
+  std::string file = configuration.name();
+  std::replace(file.begin(), file.end(), '/', '_');
+
+  std::shared_ptr<Outputter> outputter =
+      configuration.buffer->create(options.directory / file);
+  {
+    LoggerSettings settings;
+    settings.m_outputters.push_back(OutputterAttachment{outputter});
+    settings.m_headerGenerators.push_back(headergen::Time());
+    settings.m_headerGenerators.push_back(headergen::Level());
+    settings.m_flushApplier = configuration.flusher->create();
+    if (configuration.fsync)
+      settings.m_durableLevel = LogLevel::Warn;
+    Repository::configure({{path, std::move(settings)}});
+  }
+  auto logger = Repository::getLogger(path, Inheritance::Enabled);
+
+  std::unique_ptr<BusyDisk> busy;
+  if (configuration.busy)
+    busy = std::make_unique<BusyDisk>(options.directory / "busy");
+
+  // Records of about 128 bytes, headers included
+  const std::uint64_t records = options.megabytes * MiB / 128 /
+                                options.threads;
+  const std::size_t syncEvery = configuration.fsync ? options.syncEvery : 0;
+  std::barrier start(static_cast<std::ptrdiff_t>(options.threads + 1));
+  std::vector<Stalls> stalls(options.threads);
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < options.threads; ++t)
+    threads.emplace_back([&, t] {
+      produce(*logger, t, records, syncEvery, start, stalls[t]);
+    });
+
+  const std::uint64_t busyBefore = busy ? busy->written() : 0;
+  start.arrive_and_wait();
+  const Clock::time_point begin = Clock::now();
+  for (std::thread &thread : threads)
+    thread.join();
+  if (configuration.fsync)
+    outputter->sync();
+  else
+    outputter->flush();
+  const std::chrono::duration<double> elapsed = Clock::now() - begin;
+
+  Result result;
+  result.seconds = elapsed.count();
+  if (busy)
+    result.busyMegabytesPerSecond =
+        static_cast<double>(busy->written() - busyBefore) / MiB /
+        result.seconds;
+  busy.reset();
+  result.metrics = outputter->getMetrics();
+  for (const Stalls &s : stalls) {
+    result.stalls += s.count;
+    result.stalled += s.total;
+    result.maxStall = std::max(result.maxStall, s.max);
+  }
+
+  // Everything was flushed above; dropping the last reference to the sink
+  // closes its file before the file is removed.
+  Repository::configure({{path, LoggerSettings{}}});
+  logger.reset();
+  outputter.reset();
+  std::filesystem::remove(options.directory / file);
+  return result;
+}
+
+bool parse(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const std::size_t equals = arg.find('=');
+    if (equals == std::string_view::npos)
+      return false;
+    const std::string_view name = arg.substr(0, equals);
+    const std::string value(arg.substr(equals + 1));
+    if (name == "--directory")
+      options.directory = value;
+    else if (name == "--megabytes")
+      options.megabytes = static_cast<std::size_t>(std::atoi(value.c_str()));
+    else if (name == "--threads")
+      options.threads = static_cast<std::size_t>(std::atoi(value.c_str()));
+    else if (name == "--sync-every")
+      options.syncEvery = static_cast<std::size_t>(std::atoi(value.c_str()));
+    else if (name == "--filter")
+      options.filter = value;
+    else if (name == "--csv")
+      options.csv = value;
+    else
+      return false;
+  }
+  return options.megabytes > 0 && options.threads > 0 &&
+         options.syncEvery > 0;
+}
+
+double millis(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse(argc, argv, options)) {
+    std::fprintf(stderr,
+                 "usage: %s [--directory=<path>] [--megabytes=<n>] "
+                 "[--threads=<n>] [--sync-every=<records>] "
+                 "[--filter=<substring>] [--csv=<file>]\n",
+                 argv[0]);
+    return 2;
+  }
+  options.directory /= "lfy_iobench_" + std::to_string(::getpid());
+  std::filesystem::create_directories(options.directory);
+
+  std::ofstream csv;
+  if (!options.csv.empty()) {
+    csv.open(options.csv);
+    csv << "configuration,buffer,flusher,sync,disk,threads,megabytes,"
+           "mb_per_s,writes_per_mb,flushes,stalls,stall_ms,stall_percent,"
+           "max_stall_us,busy_mb_per_s\n";
+  }
+
+  std::printf("%zu MiB from %zu threads into %s; stalls are calls over "
+              "%lld us\n",
+              options.megabytes, options.threads,
+              options.directory.c_str(),
+              static_cast<long long>(StallThreshold.count()));
+  std::printf("%-38s %9s %9s %9s %9s %10s %7s %11s %9s\n", "configuration",
+              "MB/s", "writes/MB", "flushes", "stalls", "stall ms", "stall%",
+              "max stall", "busy MB/s");
+
+  const std::vector<Buffer> allBuffers = buffers();
+  const std::vector<FlushPolicy> allFlushers = flushPolicies();
+  for (const bool busy : {false, true}) {
+    for (const bool fsync : {false, true}) {
+      for (const Buffer &buffer : allBuffers) {
+        for (const FlushPolicy &flusher : allFlushers) {
+          const Configuration configuration{&buffer, &flusher, fsync, busy};
+          const std::string name = configuration.name();
+          if (name.find(options.filter) == std::string::npos)
+            continue;
+          Result result;
+          try {
+            result = measure(configuration, options);
+          } catch (const std::exception &e) {
+            std::fprintf(stderr, "%s skipped: %s\n", name.c_str(), e.what());
+            continue;
+          }
+
+          const double megabytes =
+              static_cast<double>(result.metrics.bytesWritten) / MiB;
+          const double megabytesPerSecond = megabytes / result.seconds;
+          const double writesPerMegabyte =
+              static_cast<double>(result.metrics.writeSyscalls) /
+              std::max(megabytes, 1e-9);
+          const double stallPercent =
+              100 * millis(result.stalled) /
+              (1e3 * result.seconds * static_cast<double>(options.threads));
+          std::printf("%-38s %9.1f %9.1f %9llu %9llu %10.1f %7.1f %11.1f "
+                      "%9.1f\n",
+                      name.c_str(), megabytesPerSecond, writesPerMegabyte,
+                      static_cast<unsigned long long>(result.metrics.flushes),
+                      static_cast<unsigned long long>(result.stalls),
+                      millis(result.stalled), stallPercent,
+                      1e3 * millis(result.maxStall),
+                      result.busyMegabytesPerSecond);
+          std::fflush(stdout);
+          if (csv.is_open())
+            csv << name << ',' << buffer.name << ',' << flusher.name << ','
+                << (fsync ? "fsync" : "nosync") << ','
+                << (busy ? "busy" : "idle") << ',' << options.threads << ','
+                << megabytes << ',' << megabytesPerSecond << ','
+                << writesPerMegabyte << ',' << result.metrics.flushes << ','
+                << result.stalls << ',' << millis(result.stalled) << ','
+                << stallPercent << ',' << 1e3 * millis(result.maxStall) << ','
+                << result.busyMegabytesPerSecond << '\n';
+        }
+      }
+    }
+  }
+
+  std::filesystem::remove_all(options.directory);
+  return 0;
+}
@@ -0,0 +1,314 @@
+// Open-loop latency harness: threads issue log calls on a fixed schedule and
+// measure each call against the time it was due, not the time it started.
+// A stall, e.g. a producer blocked behind a flush, then shows up in the
+// latency of every call it delayed, instead of only in one slow call
+// (coordinated omission). The uncorrected service time is reported next to
+// it for comparison.
+//
+//   lfy_latency [--rate=<calls per second>] [--threads=<n>]
+//               [--duration=<seconds>] [--filter=<substring>]
+//               [--csv=<file>]
+//
+// Runs each configuration (sink, buffer size, flusher) in turn and prints
+// p50, p99, p99.9 and the maximum in microseconds; percentiles are upper
+// bounds of log-linear buckets, up to 1/8 too high. The rate is the total of
+// all threads. Files go to a temporary directory, which is removed at exit.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "lfy/CompressedOutputter.hpp"
+#include "lfy/DirectOutputter.hpp"
+#include "lfy/HeaderGen.hpp"
+#include "lfy/Histogram.hpp"
+#include "lfy/Logger.hpp"
+#include "lfy/MappedOutputter.hpp"
+#include "lfy/Outputter.hpp"
+#include "lfy/Repository.hpp"
+#include "lfy/UringOutputter.hpp"
+
+namespace {
+
+using namespace lfy;
+using namespace lfy::literals;
+using Clock = std::chrono::steady_clock;
+
+// Discards all records, the baseline of the logger itself.
+class NullOutputter : public Outputter {
+public:
+  void output(const std::string &) override {}
+  Clock::time_point lastFlush() override { return Clock::now(); }
+  void flush() override {}
+};
+
+struct Configuration {
+  std::string name;
+  std::function<std::shared_ptr<Outputter>(const std::filesystem::path &)>
+      sink;
+  Flusher flusher;
+};
+
+struct Options {
+  double rate{100'000};
+  std::size_t threads{4};
+  double duration{2};
+  std::string filter;
+  std::string csv;
+};
+
+// Latencies of one thread, in nanoseconds.
+struct Latencies {
+  void add(std::uint64_t nanoseconds) {
+    ++histogram.counts[LatencyHistogram::bucketOf(nanoseconds)];
+    histogram.sum += nanoseconds;
+    max = std::max(max, nanoseconds);
+  }
+
+  void merge(const Latencies &other) {
+    for (std::size_t i = 0; i < LatencyHistogram::Buckets; ++i)
+      histogram.counts[i] += other.histogram.counts[i];
+    histogram.sum += other.histogram.sum;
+    max = std::max(max, other.max);
+  }
+
+  LatencyHistogram::Snapshot histogram;
+  std::uint64_t max{0};
+};
+
+struct Result {
+  Latencies corrected;   // Since the call was due
+  Latencies uncorrected; // Since the call started
+  std::uint64_t calls{0};
+};
+
+std::filesystem::path directory() {
+  static const std::filesystem::path path = [] {
+    auto p = std::filesystem::temp_directory_path() /
+             ("lfy_latency_" + std::to_string(::getpid()));
+    std::filesystem::create_directories(p);
+    return p;
+  }();
+  return path;
+}
+
+std::vector<Configuration> configurations() {
+  using namespace std::chrono_literals;
+  auto file = [](auto capacity) {
+    return [capacity](const std::filesystem::path &path) {
+      return std::shared_ptr<Outputter>(outputters::File(path, capacity));
+    };
+  };
+  return {
+      {"null", [](const auto &) { return std::make_shared<NullOutputter>(); },
+       flushers::Automatic()},
+      {"file_4k/automatic", file(BufferCapacity<4_KiB>{}),
+       flushers::Automatic()},
+      {"file_16k/automatic", file(BufferCapacity<16_KiB>{}),
+       flushers::Automatic()},
+      {"file_64k/automatic", file(BufferCapacity<64_KiB>{}),
+       flushers::Automatic()},
+      {"file_256k/automatic", file(BufferCapacity<256_KiB>{}),
+       flushers::Automatic()},
+      {"file_64k/every_100", file(BufferCapacity<64_KiB>{}),
+       flushers::EveryNthMessage(100)},
+      {"file_64k/lazy_timed_1s", file(BufferCapacity<64_KiB>{}),
+       flushers::LazyTimed(1s)},
+      {"file_64k/always", file(BufferCapacity<64_KiB>{}), flushers::Always()},
+      {"mapped", [](const auto &path) { return outputters::MappedFile(path); },
+       flushers::Automatic()},
+      {"direct", [](const auto &path) { return outputters::DirectFile(path); },
+       flushers::Automatic()},
+      {"uring", [](const auto &path) { return outputters::UringFile(path); },
+       flushers::Automatic()},
+      {"compressed",
+       [](const auto &path) { return outputters::CompressedFile(path); },
+       flushers::Automatic()},
+  };
+}
+
+// Issues calls at start + i * interval until the end, waiting for calls which
+// are not due yet. A thread which fell behind issues the due calls back to
+// back, as the load of a real application would not wait either.
+void produce(Logger &logger, Clock::time_point start, Clock::duration interval,
+             Clock::time_point end, Result &result) {
+  for (std::uint64_t i = 0;; ++i) {
+    const Clock::time_point due = start + i * interval;
+    if (due >= end)
+      return;
+    Clock::time_point now = Clock::now();
+    if (now < due) {
+      if (due - now > std::chrono::microseconds(100))
+        std::this_thread::sleep_until(due - std::chrono::microseconds(50));
+      // Yields while spinning, threads may outnumber the cores.
+      while ((now = Clock::now()) < due)
+        std::this_thread::yield();
+    }
+    logger.info("request {} served in {} us", i, 42);
+    const Clock::time_point done = Clock::now();
+    result.corrected.add(static_cast<std::uint64_t>(
+        std::chrono::nanoseconds(done - due).count()));
+    result.uncorrected.add(static_cast<std::uint64_t>(
+        std::chrono::nanoseconds(done - now).count()));
+    ++result.calls;
+  }
+}
+
+Result measure(const Configuration &configuration, const Options &options) {
+  const std::string path = "latency";
+  std::string file = configuration.name;
+  std::replace(file.begin(), file.end(), '/', '_');
+  std::shared_ptr<Outputter> sink = configuration.sink(directory() / file);
+  {
+    LoggerSettings settings;
+    settings.m_outputters.push_back(OutputterAttachment{sink});
+    settings.m_headerGenerators.push_back(headergen::Time());
+    settings.m_headerGenerators.push_back(headergen::Level());
+    settings.m_flushApplier = configuration.flusher;
+    Repository::configure({{path, std::move(settings)}});
+  }
+  auto logger = Repository::getLogger(path, Inheritance::Enabled);
+
+  const auto interval =
+      std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(
+          static_cast<double>(options.threads) / options.rate));
+  const Clock::time_point start = Clock::now() + std::chrono::milliseconds(10);
+  const Clock::time_point end =
+      start + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double>(options.duration));
+
+  std::vector<Result> results(options.threads);
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < options.threads; ++t) {
+    // Threads are staggered within one interval, as independent clients.
+    const Clock::time_point first = start + interval * t / options.threads;
+    threads.emplace_back([&, t, first] {
+      produce(*logger, first, interval, end, results[t]);
+    });
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+
+  // The sink writes out and closes its file before the file is removed, so
+  // its background work does not overlap the next configuration.
+  Repository::configure({{path, LoggerSettings{}}});
+  sink->flush();
+  sink.reset();
+  std::filesystem::remove(directory() / file);
+
+  Result total;
+  for (const Result &result : results) {
+    total.corrected.merge(result.corrected);
+    total.uncorrected.merge(result.uncorrected);
+    total.calls += result.calls;
+  }
+  return total;
+}
+
+bool parse(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const std::size_t equals = arg.find('=');
+    if (equals == std::string_view::npos)
+      return false;
+    const std::string_view name = arg.substr(0, equals);
+    const std::string value(arg.substr(equals + 1));
+    if (name == "--rate")
+      options.rate = std::atof(value.c_str());
+    else if (name == "--threads")
+      options.threads = static_cast<std::size_t>(std::atoi(value.c_str()));
+    else if (name == "--duration")
+      options.duration = std::atof(value.c_str());
+    else if (name == "--filter")
+      options.filter = value;
+    else if (name == "--csv")
+      options.csv = value;
+    else
+      return false;
+  }
+  return options.rate > 0 && options.threads > 0 && options.duration > 0;
+}
+
+double micros(std::uint64_t nanoseconds) {
+  return static_cast<double>(nanoseconds) / 1e3;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse(argc, argv, options)) {
+    std::fprintf(stderr,
+                 "usage: %s [--rate=<calls per second>] [--threads=<n>] "
+                 "[--duration=<seconds>] [--filter=<substring>] "
+                 "[--csv=<file>]\n",
+                 argv[0]);
+    return 2;
+  }
+
+  std::ofstream csv;
+  if (!options.csv.empty()) {
+    csv.open(options.csv);
+    csv << "configuration,threads,rate,calls,"
+           "p50_us,p99_us,p999_us,max_us,"
+           "service_p50_us,service_p99_us,service_p999_us,service_max_us\n";
+  }
+
+  std::printf("%.0f calls/s from %zu threads for %.1f s; latency since due "
+              "(service time since start) in us\n",
+              options.rate, options.threads, options.duration);
+  std::printf("%-26s %10s %17s %17s %17s %19s\n", "configuration", "calls",
+              "p50", "p99", "p99.9", "max");
+  for (const Configuration &configuration : configurations()) {
+    if (configuration.name.find(options.filter) == std::string::npos)
+      continue;
+    Result result;
+    try {
+      result = measure(configuration, options);
+    } catch (const std::exception &e) {
+      std::fprintf(stderr, "%s skipped: %s\n", configuration.name.c_str(),
+                   e.what());
+      continue;
+    }
+
+    const auto &c = result.corrected;
+    const auto &u = result.uncorrected;
+    const double values[] = {micros(c.histogram.valueAt(0.5)),
+                             micros(c.histogram.valueAt(0.99)),
+                             micros(c.histogram.valueAt(0.999)),
+                             micros(c.max),
+                             micros(u.histogram.valueAt(0.5)),
+                             micros(u.histogram.valueAt(0.99)),
+                             micros(u.histogram.valueAt(0.999)),
+                             micros(u.max)};
+    std::printf("%-26s %10llu %8.1f (%6.1f) %8.1f (%6.1f) %8.1f (%6.1f) "
+                "%9.1f (%7.1f)\n",
+                configuration.name.c_str(),
+                static_cast<unsigned long long>(result.calls), values[0],
+                values[4], values[1], values[5], values[2], values[6],
+                values[3], values[7]);
+    std::fflush(stdout);
+    if (csv.is_open()) {
+      csv << configuration.name << ',' << options.threads << ','
+          << options.rate << ',' << result.calls;
+      for (const double value : values)
+        csv << ',' << value;
+      csv << '\n';
+    }
+  }
+
+  std::filesystem::remove_all(directory());
+  return 0;
+}
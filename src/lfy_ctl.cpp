@@ -0,0 +1,34 @@
+// Command line client of lfy::ControlServer.
+//
+//   lfy-ctl <socket> <command> [arguments...]
+//
+// Prints the reply and exits with 1, if the command failed.
+
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "lfy/details/ControlSocketLinux.hpp"
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::fprintf(stderr, "usage: %s <socket> <command> [arguments...]\n"
+                         "       %s <socket> help\n",
+                 argv[0], argv[0]);
+    return 2;
+  }
+
+  std::string command = argv[2];
+  for (int i = 3; i < argc; ++i)
+    command.append(" ").append(argv[i]);
+
+  const std::optional<std::string> reply =
+      lfy::details::control_request(argv[1], command);
+  if (!reply) {
+    std::fprintf(stderr, "%s: cannot reach %s\n", argv[0], argv[1]);
+    return 2;
+  }
+  std::fwrite(reply->data(), 1, reply->size(), stdout);
+  return std::string_view(*reply).ends_with("ok\n") ? 0 : 1;
+}